@@ -12,15 +12,25 @@ namespace linklayer {
     struct Action {
         State state{Idle};
         int id{};
+        int node{};   /* Dense index of the node. */
         int chn{};
+        long long frame{};  /* Handle of a transmitted frame. */
         double start{};
         double end{};
 
-        bool is_within(const Action &action) const;
+        bool is_within(const Action &action) const {
+            return this->start >= action.start && this->end <= action.end;
+        }
 
-        bool operator==(const Action &rhs) const;
+        bool operator==(const Action &rhs) const {
+            return state == rhs.state &&
+                   id == rhs.id &&
+                   chn == rhs.chn;
+        }
 
-        bool operator!=(const Action &rhs) const;
+        bool operator!=(const Action &rhs) const {
+            return !(rhs == *this);
+        }
 
         Action() = default;
 
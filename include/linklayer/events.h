@@ -0,0 +1,164 @@
+#ifndef LINKLAYER_EVENTS_H
+#define LINKLAYER_EVENTS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+namespace linklayer {
+
+    enum EventType {
+        BeginSend,
+        EndSend,
+        EndFrame,
+        BeginListen,
+    };
+
+    struct Event {
+        EventType type{};
+        int id{};
+        int chn{};
+        long long frame{};
+        double timestamp{};
+        double duration{};
+
+        std::uint64_t sequence{};  /* Arrival order at the consumer, ordering events with equal timestamps. */
+        Event *next{};
+    };
+
+    /**
+     * Lock-free multi-producer, single-consumer queue of events.
+     *
+     * Producers push onto an intrusive stack with a CAS loop; the consumer detaches
+     * the whole stack at once, so producers never wait on each other or the consumer.
+     * Detached events wait in a consumer-side min-heap until they are taken.
+     */
+    class EventQueue {
+    public:
+        EventQueue() = default;
+
+        EventQueue(const EventQueue &other) : pending(other.pending), arrivals(other.arrivals) {
+            /* Copies are not synchronised with producers of the original. */
+            Event *tail = nullptr;
+            for (auto *event = other.head.load(std::memory_order_acquire); event; event = event->next) {
+                auto *copy = new Event{*event};
+                copy->next = nullptr;
+
+                if (tail) {
+                    tail->next = copy;
+                } else {
+                    head.store(copy, std::memory_order_relaxed);
+                }
+                tail = copy;
+            }
+
+            active.store(other.enabled(), std::memory_order_relaxed);
+        }
+
+        EventQueue &operator=(const EventQueue &other) = delete;
+
+        ~EventQueue() {
+            auto *event = head.load(std::memory_order_acquire);
+            while (event) {
+                auto *next = event->next;
+                delete event;
+                event = next;
+            }
+        }
+
+        bool enabled() const {
+            return active.load(std::memory_order_relaxed);
+        }
+
+        void enable(bool enable) {
+            active.store(enable, std::memory_order_relaxed);
+        }
+
+        bool empty() const {
+            return head.load(std::memory_order_acquire) == nullptr && pending.empty();
+        }
+
+        void push(const Event &event) {
+            auto *node = new Event{event};
+            node->next = head.load(std::memory_order_relaxed);
+            while (!head.compare_exchange_weak(node->next, node, std::memory_order_release,
+                                               std::memory_order_relaxed)) {}
+        }
+
+        /**
+         * Detach the pending events at or before a timestamp, ordered by timestamp and then by push order.
+         * Later events stay pending.
+         */
+        std::vector<Event> take(double until = std::numeric_limits<double>::infinity()) {
+            this->drain();
+
+            std::vector<Event> events{};
+            while (!pending.empty() && pending.front().timestamp <= until) {
+                std::pop_heap(pending.begin(), pending.end(), later);
+                events.push_back(pending.back());
+                pending.pop_back();
+            }
+
+            return events;
+        }
+
+        /**
+         * Events detached from producers but not yet taken, in heap order. See drain().
+         */
+        const std::vector<Event> &waiting() const {
+            return pending;
+        }
+
+        /**
+         * Detach all events pushed so far into the pending heap.
+         */
+        void drain() {
+            std::vector<Event> events{};
+            auto *event = head.exchange(nullptr, std::memory_order_acquire);
+
+            while (event) {
+                auto *next = event->next;
+                events.push_back(*event);
+                delete event;
+                event = next;
+            }
+
+            /* The stack holds the newest event first. */
+            for (auto it = events.rbegin(); it != events.rend(); ++it) {
+                it->next = nullptr;
+                it->sequence = arrivals++;
+                pending.push_back(*it);
+                std::push_heap(pending.begin(), pending.end(), later);
+            }
+        }
+
+        /**
+         * Replace the pending events with ones saved from waiting().
+         */
+        void restore(std::vector<Event> events) {
+            pending = std::move(events);
+            for (auto &event : pending) {
+                event.next = nullptr;
+                arrivals = std::max(arrivals, event.sequence + 1);
+            }
+            std::make_heap(pending.begin(), pending.end(), later);
+        }
+
+    private:
+        std::atomic<Event *> head{nullptr};
+        std::atomic<bool> active{false};
+
+        std::vector<Event> pending{};  /* Min-heap by timestamp and sequence, owned by the consumer. */
+        std::uint64_t arrivals{};
+
+        static bool later(const Event &a, const Event &b) {
+            return a.timestamp > b.timestamp || (a.timestamp == b.timestamp && a.sequence > b.sequence);
+        }
+
+    };
+
+}
+
+#endif /* LINKLAYER_EVENTS_H */
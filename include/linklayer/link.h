@@ -0,0 +1,32 @@
+#ifndef LINKLAYER_LINK_H
+#define LINKLAYER_LINK_H
+
+#include <utility>
+
+namespace linklayer {
+
+    struct Link {
+
+        Link() = default;
+
+        Link(unsigned long long id, unsigned long n1, unsigned long n2) : id(id), nodes(n1, n2) {}
+
+        bool operator==(const Link &rhs) const {
+            return id == rhs.id;
+        }
+
+        bool operator!=(const Link &rhs) const {
+            return !(rhs == *this);
+        }
+
+        unsigned long long id{};
+        std::pair<unsigned long, unsigned long> nodes;  /* Node identifiers. */
+
+        double rssi{};
+        bool silent{};  /* RSSI of zero, treated as no link for reception. */
+    };
+
+}
+
+
+#endif //LINKLAYER_LINK_H
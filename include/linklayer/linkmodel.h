@@ -7,6 +7,40 @@
 extern "C" {
 #endif
 
+/**
+ * Call count and accumulated wall time of a single API function.
+ */
+struct lm_call_stats {
+    unsigned long long calls;
+    unsigned long long nanoseconds;
+};
+
+/**
+ * Runtime instrumentation counters of a link model.
+ *
+ * Counters are only maintained when the library is built with LINKLAYER_STATS enabled.
+ * In queued mode, begin_send(), end_send(), end_frame() and begin_listen() are counted when
+ * their events are applied, and the time spent applying them is included in the caller's query.
+ */
+struct lm_stats {
+    struct lm_call_stats is_connected;
+    struct lm_call_stats begin_send;
+    struct lm_call_stats end_send;
+    struct lm_call_stats begin_listen;
+    struct lm_call_stats status;
+    struct lm_call_stats end_listen;
+    struct lm_call_stats alive_nodes;
+
+    unsigned long long topology_hits;         /* Topology lookups served from the cache */
+    unsigned long long topology_misses;       /* Topology lookups that had to generate links */
+    unsigned long long topologies_generated;  /* Topologies generated with at least one link */
+    unsigned long long links_scanned;         /* Links visited during link lookups */
+    unsigned long long interferers_evaluated; /* Interfering transmissions considered in PEP evaluation */
+    unsigned long long coupled_channels_scanned; /* Coupled channels with transmitters scanned for leakage */
+    unsigned long long pep_cache_hits;        /* PEP evaluations served from the cache */
+    unsigned long long pep_cache_misses;      /* PEP evaluations computed with the cache enabled */
+};
+
 /**
  * Initialize the link model.
  *
@@ -35,17 +69,24 @@ void deinit(void *model);
 bool is_connected(void *model, int x, int y, double timestamp);
 
 /**
- * Notify the link model that a node starts sending on a specific channel.
+ * Notify the link model that a node starts sending a frame on a specific channel.
+ *
+ * A node may have several overlapping frames on the same channel, all of which
+ * interfere with other receptions. Frames of the node that ended before this one starts
+ * and cannot overlap a listen still open on the channel are released. At most 64 frames are
+ * kept per node and channel; beyond that the oldest is released even if a listen is still open.
+ *
  * @param model The link model object
  * @param id Node identifier
  * @param chn Channel identifier
  * @param timestamp Timestamp to start sending
  * @param duration Duration to transmit in
+ * @return Positive handle of the frame, 0 if the event was queued (see set_queued()), or -1 on failure.
  */
-void begin_send(void *model, int id, int chn, double timestamp, double duration);
+long long begin_send(void *model, int id, int chn, double timestamp, double duration);
 
 /**
- * Notify the link model that a node stops sending on a specific channel.
+ * Notify the link model that a node stops sending its most recent frame on a specific channel.
  * @param model The link model object
  * @param id Node identifier
  * @param chn Channel identifier
@@ -53,8 +94,25 @@ void begin_send(void *model, int id, int chn, double timestamp, double duration)
  */
 void end_send(void *model, int id, int chn, double timestamp);
 
+/**
+ * Notify the link model that a frame stops being sent.
+ *
+ * Handles of frames that have already been retired are ignored, as long as their slot has been
+ * reused fewer than 2^32 - 1 times since.
+ *
+ * @param model The link model object
+ * @param frame Frame handle returned by begin_send()
+ * @param timestamp Timestamp to stop sending
+ */
+void end_frame(void *model, long long frame, double timestamp);
+
 /**
  * Notify the link model that a node starts listening on a specific channel.
+ *
+ * The listen stays open until end_listen() is called, even past its duration. While open, it keeps
+ * the frames overlapping it on its channel and coupled channels from being released, so callers
+ * should end every listen.
+ *
  * @param model The link model object
  * @param id Node identifier
  * @param chn Channel identifier
@@ -83,6 +141,81 @@ int status(void *model, int id, int chn, double timestamp);
  */
 int end_listen(void *model, int id, int chn, double timestamp);
 
+/**
+ * Advance the clock of the link model to timestamp.
+ *
+ * Transmissions that ended before the earliest start of a listen still open on their channel are retired,
+ * keeping the per-channel state proportional to the number of concurrent actions. Listens are retired by
+ * end_listen(), so a listen that is never ended holds back retirement on its channel. Without calling
+ * this, frames are still released by later sends of the same node (see begin_send()).
+ * Actions must not be started before the clock once it has been advanced.
+ *
+ * @param model The link model object
+ * @param timestamp Timestamp that no later action will start before
+ */
+void advance(void *model, double timestamp);
+
+/**
+ * Advance the clock with the timestamp of every call.
+ *
+ * When enabled, begin_send(), end_send(), end_frame(), begin_listen(), status() and end_listen()
+ * advance the clock as advance() does, so callers with monotone timestamps never need to call it.
+ * Disabled by default, as callers may register actions out of order.
+ *
+ * @param model The link model object
+ * @param enabled True if timestamps of calls are monotone
+ */
+void set_auto_advance(void *model, bool enabled);
+
+/**
+ * Enable or disable queued ingestion of events.
+ *
+ * When enabled, begin_send(), end_send(), end_frame() and begin_listen() push events onto a
+ * lock-free queue and may be called concurrently from several threads. Pending events up to the
+ * timestamp of the next call to is_connected(), status(), end_listen(), alive_nodes() or advance()
+ * are applied by it in timestamp order; later events stay pending. These calls must not be made
+ * concurrently with each other. Frame handles are not available for queued sends. Disabling applies
+ * all pending events.
+ *
+ * @param model The link model object
+ * @param enabled True to queue events
+ */
+void set_queued(void *model, bool enabled);
+
+/**
+ * Set the capacity of the packet error probability cache.
+ *
+ * The cache remembers the result of each (epoch, transmitter, receiver, interferer set) combination,
+ * evicting the least recently used entry when full. It is disabled with a capacity of 0, the default.
+ *
+ * @param model The link model object
+ * @param capacity Maximum number of cached probabilities
+ */
+void set_pep_cache(void *model, unsigned long capacity);
+
+/**
+ * Set the coupling between two channels.
+ *
+ * Transmissions on one channel interfere with listens on the other, attenuated by the given amount.
+ * Channels are isolated by default, and only coupled channels with frames on air are scanned.
+ * Attenuations of about 125 dB or more put even a 0 dBm interferer 10 dB below the noise floor and
+ * remove the coupling. Couplings should be set before the simulation starts, as frames already
+ * retired on a channel are not reconsidered.
+ *
+ * @param model The link model object
+ * @param a First channel
+ * @param b Second channel
+ * @param attenuation Attenuation in dB, INFINITY to remove the coupling
+ */
+void set_channel_coupling(void *model, int a, int b, double attenuation);
+
+/**
+ * Get the fraction of packet error probability lookups served from the cache.
+ * @param model The link model object
+ * @return Hit rate between 0 and 1, 0 if the cache has not been used
+ */
+double pep_cache_hit_rate(void *model);
+
 /**
  * Get an array of node identifiers of all nodes alive at a given timestamp.
  *
@@ -95,6 +228,47 @@ int end_listen(void *model, int id, int chn, double timestamp);
  */
 int *alive_nodes(void *model, double timestamp, int *node_count);
 
+/**
+ * Save the state of the link model to a file.
+ *
+ * The file holds frames, listens, generated topologies, settings, the random number generator
+ * state and queued events not yet applied in native binary form. Pending events are saved unapplied
+ * and are applied by the restored model as its queries reach their timestamps. The GPS log is referred to by path and must be unchanged when loading.
+ *
+ * @param model The link model object
+ * @param path Filepath to write the state to
+ * @return True on success
+ */
+bool save_state(void *model, const char *path);
+
+/**
+ * Create a link model from a state saved with save_state().
+ *
+ * Models restored while another model of the same GPS log exists share its parsed log, so many
+ * branches can be forked from one snapshot cheaply. Instrumentation counters start at zero.
+ *
+ * @param path Filepath of the saved state
+ * @return Pointer to the link model object, or NULL on failure
+ */
+void *load_state(const char *path);
+
+/**
+ * Copy the instrumentation counters of the link model.
+ *
+ * If the library was built without LINKLAYER_STATS, stats is zeroed.
+ *
+ * @param model The link model object
+ * @param stats Destination for the counters
+ * @return True if the counters are maintained by this build
+ */
+bool get_stats(void *model, struct lm_stats *stats);
+
+/**
+ * Reset all instrumentation counters of the link model to zero.
+ * @param model The link model object
+ */
+void reset_stats(void *model);
+
 #ifdef __cplusplus
 }
 #endif
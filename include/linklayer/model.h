@@ -0,0 +1,950 @@
+#ifndef LINKLAYER_MODEL_H
+#define LINKLAYER_MODEL_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <linklayer/linkmodel.h>
+#include <linklayer/action.h>
+#include <linklayer/events.h>
+#include <linklayer/link.h>
+#include <linklayer/pep_cache.h>
+#include <linklayer/ring.h>
+#include <linklayer/stats.h>
+
+namespace linklayer {
+    const int LM_ERROR = -1;
+
+    const int FRAME_GENERATION_BITS = 32;
+    const int FRAME_INDEX_BITS = 31;  /* Slots are bounded by frames on air, far below 2^31 per model. */
+    const long long FRAME_INDEX_MASK = (1ll << FRAME_INDEX_BITS) - 1;
+
+    const std::size_t MAX_NODE_FRAMES = 64;  /* Frames kept per node and channel, whatever listens are open. */
+
+    const unsigned long MAX_TABLE_ID = 1ul << 20;  /* Larger node identifiers are looked up by binary search. */
+
+    const double TIME_GAP = 20000.0;
+
+    const unsigned long PACKET_SIZE = 20;
+    const double THERMAL_NOISE = -119.66;
+    const double NOISE_FIGURE = 4.2;
+
+    /* Channel coupling attenuation in dB that puts a 0 dBm interferer 10 dB below the noise floor. */
+    const double NEGLIGIBLE_COUPLING = 10.0 - (THERMAL_NOISE + NOISE_FIGURE);
+
+    struct Topology {
+        double timestamp{};
+        bool generated{};
+        std::vector<linklayer::Link> links{};
+
+        /* Links of node i are adjacency[offsets[i]] to adjacency[offsets[i + 1] - 1], sorted by neighbour. */
+        std::vector<std::size_t> offsets{};
+        std::vector<std::pair<std::size_t, std::size_t>> adjacency{};  /* Neighbour index and link position. */
+    };
+
+    /**
+     * Orders timestamps, treating nearly equal timestamps as the same.
+     */
+    struct TimeLess {
+        bool operator()(double lhs, double rhs) const;
+    };
+
+    using TopologyMap = std::map<double, Topology, TimeLess>;
+
+    using TimedEntry = std::pair<double, long long>;  /* Timestamp and frame handle or node index, ordered in min-heaps. */
+    using TimedHeap = std::vector<TimedEntry>;
+
+    /**
+     * Parsed GPS log. Immutable, and shared by all models created from it.
+     */
+    struct Trace;
+
+    /**
+     * Parse a GPS log.
+     *
+     * A log that is still in use by another model is not parsed again, its trace is shared instead.
+     * Throws std::runtime_error if the log cannot be read or contains no nodes.
+     *
+     * @param gpslog Filepath for a log of GPS coordinates for all nodes
+     * @return The parsed trace
+     */
+    std::shared_ptr<const Trace> load_trace(const char *gpslog);
+
+    /**
+     * Leading part of a saved model state, naming the trace and channel count it was saved with.
+     */
+    struct StateHeader {
+        std::string gpslog{};  /* Canonical path. */
+        std::uint64_t fingerprint{};  /* Hash of the parsed log, checked against the loaded trace. */
+        int nchans{};
+    };
+
+    /**
+     * Read the header of a saved model state. Throws std::runtime_error if it is not a saved state.
+     */
+    StateHeader read_state_header(std::istream &in);
+
+    inline double linearize(double logarithmic_value) {
+        return std::pow(10, logarithmic_value / 10);
+    }
+
+    inline double logarithmicize(double linear_value) {
+        return 10 * std::log10(linear_value);
+    }
+
+    inline double pep(double rssi, unsigned long packetsize, const std::vector<double> &interference) {
+        auto P_N_dB = linklayer::THERMAL_NOISE + linklayer::NOISE_FIGURE;
+        auto P_N = linearize(P_N_dB);
+
+        auto P_I = 0.0;
+        for (auto &RSSI_interference_dB : interference) {
+            P_I += linearize(RSSI_interference_dB);
+        }
+
+        auto P_NI = P_N + P_I;
+        auto P_NI_dB = logarithmicize(P_NI);
+        auto SINR_dB = rssi - P_NI_dB;
+        auto SINR = linearize(SINR_dB);
+
+        auto bep = 0.5 * std::erfc(std::sqrt(SINR / 2.0));  /* Bit error probability. */
+        auto pep = 1.0 - std::pow((1.0 - bep), packetsize * 8.0); /* Packet error probability. */
+        return pep;
+    }
+
+    /**
+     * Default reception model: packet error probability of a PACKET_SIZE packet.
+     *
+     * A reception model provides static double error(double rssi, const std::vector<double> &interference).
+     */
+    struct PepReception {
+        static double error(double rssi, const std::vector<double> &interference) {
+            return linklayer::pep(rssi, linklayer::PACKET_SIZE, interference);
+        }
+    };
+
+    /**
+     * Node identifiers of a trace and their dense indices, shared by all models of the trace.
+     */
+    struct NodeIndex {
+        std::vector<unsigned long> ids{};  /* Sorted, positions are node indices. */
+        std::vector<int> table{};  /* Node identifier to node index, -1 if unknown. */
+
+        int index_of(int id) const {
+            if (id < 0) {
+                return -1;
+            }
+
+            auto uid = static_cast<unsigned long>(id);
+            if (uid < this->table.size()) {
+                return this->table[uid];
+            }
+
+            auto it = std::lower_bound(this->ids.begin(), this->ids.end(), uid);
+            if (it == this->ids.end() || *it != uid) {
+                return -1;
+            }
+
+            return static_cast<int>(it - this->ids.begin());
+        }
+    };
+
+    /**
+     * Dynamic state of a link model: topologies, transmissions and listens.
+     * Internal, Model exposes the supported operations.
+     */
+    struct LinkModel {
+        LinkModel(int nchans, std::shared_ptr<const Trace> trace);
+
+        std::shared_ptr<const Trace> trace{};
+        TopologyMap topologies{};
+        const NodeIndex *node_index{};  /* Owned by the trace. */
+
+        std::vector<std::vector<Action>> tx{};  /* Frame slots, Idle when free. */
+        std::vector<std::vector<Action>> rx{};
+
+        std::vector<std::vector<std::size_t>> tx_free{};  /* Free frame slots per channel. */
+        std::vector<std::vector<RingBuffer<long long>>> senders{};  /* Frame handles per channel per node index. */
+        std::vector<std::vector<int>> listeners{};  /* Position in rx per channel per node index, -1 if none. */
+
+        /* Per channel, heaps of frame ends and listen starts. Entries outdated by later changes are skipped. */
+        std::vector<TimedHeap> expiries{};
+        std::vector<TimedHeap> listen_starts{};
+
+        EventQueue events{};  /* Pending begin/end events in queued mode. */
+
+        PepCache pep_cache{};  /* Disabled unless given a capacity. */
+
+        lm_stats stats{};
+
+        double now{};       /* Clock, nothing starts before it. */
+        bool auto_advance{};  /* Advance the clock with the timestamp of every call. */
+        std::vector<double> watermark{}; /* Per channel, nothing before this time can affect an active listen. */
+
+        std::vector<std::vector<std::pair<int, double>>> coupling{};  /* Per channel, coupled channels and attenuation in dB. */
+        std::vector<std::size_t> active{};  /* Transmitting frames per channel. */
+        std::vector<std::uint64_t> active_bits{};  /* Channels with transmitting frames. */
+
+        struct Interferer {
+            std::size_t node;
+            const Topology *topology;
+            double attenuation;
+        };
+
+        int index_of(int id) const {
+            return this->node_index->index_of(id);
+        }
+
+        const linklayer::Link get_link(int x, int y, double timestamp) {
+            auto xi = this->index_of(x);
+            auto yi = this->index_of(y);
+            if (xi < 0 || yi < 0) {
+                return linklayer::Link{}; /* Unknown node. */
+            }
+
+            auto *link = this->find_link(static_cast<std::size_t>(xi), static_cast<std::size_t>(yi), timestamp);
+            if (link == nullptr) {
+                return linklayer::Link{}; /* No link found. */
+            }
+
+            return *link;
+        }
+
+        const linklayer::Link *find_link(std::size_t x, std::size_t y, double timestamp) {
+            return this->find_link(this->get_topology(timestamp), x, y);
+        }
+
+        const linklayer::Link *find_link(const Topology &topology, std::size_t x, std::size_t y) {
+            auto begin = topology.adjacency.begin() + topology.offsets[x];
+            auto end = topology.adjacency.begin() + topology.offsets[x + 1];
+            auto it = std::lower_bound(begin, end, y, [this](const std::pair<std::size_t, std::size_t> &entry,
+                                                             std::size_t node) {
+                LM_STATS_ADD(this, links_scanned, 1);
+                return entry.first < node;
+            });
+
+            if (it == end || it->first != y) {
+                return nullptr;
+            }
+
+            return &topology.links[it->second];
+        }
+
+        template<typename Reception = PepReception>
+        double should_receive(const Action &t, const Action &r, const std::vector<Action> &tx_list) {
+            auto &topology = this->get_topology(t.start);
+            auto *link = this->find_link(topology, t.node, r.node);
+            if (link == nullptr || link->silent) {
+                /* No link. */
+                return false;
+            }
+
+            std::vector<Interferer> interferers{};
+            for (auto &tx_i : tx_list) {
+                if (tx_i.state != Transmit || tx_i.frame == t.frame) {
+                    /* No interference from free slots or the frame itself. */
+                    continue;
+                }
+
+                if (t.end <= tx_i.start || t.start >= tx_i.end) {
+                    /* Time interval does not intersect. */
+                    continue;
+                }
+
+                LM_STATS_ADD(this, interferers_evaluated, 1);
+                interferers.push_back({static_cast<std::size_t>(tx_i.node), &this->get_topology(tx_i.start), 0.0});
+            }
+
+            /* Leakage from coupled channels, visiting only those with transmitting frames. */
+            for (auto &coupled : this->coupling[r.chn]) {
+                if (!this->is_active(coupled.first)) {
+                    continue;
+                }
+
+                LM_STATS_ADD(this, coupled_channels_scanned, 1);
+
+                for (auto &tx_i : this->tx[coupled.first]) {
+                    if (tx_i.state != Transmit || t.end <= tx_i.start || t.start >= tx_i.end) {
+                        continue;
+                    }
+
+                    LM_STATS_ADD(this, interferers_evaluated, 1);
+                    interferers.push_back({static_cast<std::size_t>(tx_i.node), &this->get_topology(tx_i.start),
+                                           coupled.second});
+                }
+            }
+
+            PepKey key{};
+            std::size_t hash{};
+            if (this->pep_cache.enabled()) {
+                key = {topology.timestamp, static_cast<std::size_t>(t.node), static_cast<std::size_t>(r.node)};
+                for (auto &interferer : interferers) {
+                    key.interferers.emplace_back(interferer.node, interferer.topology->timestamp,
+                                                 interferer.attenuation);
+                }
+                std::sort(key.interferers.begin(), key.interferers.end());
+                hash = key.hash();
+
+                auto *cached = this->pep_cache.find(key, hash);
+                if (cached) {
+                    LM_STATS_ADD(this, pep_cache_hits, 1);
+                    return *cached;
+                }
+                LM_STATS_ADD(this, pep_cache_misses, 1);
+            }
+
+            std::vector<double> interference{};
+            auto rssi = link->rssi;
+
+            for (auto &interferer : interferers) {
+                auto *link_i = this->find_link(*interferer.topology, interferer.node, r.node);
+                if (link_i == nullptr || link_i->silent) {
+                    continue;
+                }
+
+                interference.push_back(link_i->rssi - interferer.attenuation);
+            }
+
+            auto pep = Reception::error(rssi, interference);
+            if (this->pep_cache.enabled()) {
+                this->pep_cache.insert(std::move(key), hash, pep);
+            }
+
+            return pep;
+        }
+
+        Topology &get_topology(double timestamp);
+
+        /**
+         * Write the dynamic state in native binary form: listens, frames, generated topologies, settings and pending events,
+         * followed by the given random number engine state. The trace is referred to by path only.
+         */
+        void save_state(std::ostream &out, const std::string &rng) const;
+
+        /**
+         * Restore the dynamic state following the header read by read_state_header().
+         * Throws std::runtime_error if the state is malformed or the header does not match the trace.
+         *
+         * @return The saved random number engine state
+         */
+        std::string restore_state(const StateHeader &header, std::istream &in);
+
+        long long begin_frame(int node, int chn, double start, double end) {
+            auto &frames = this->tx[chn];
+            auto &free = this->tx_free[chn];
+
+            /*
+             * Reclaim the node's frames that ended before this one starts and cannot overlap an open listen,
+             * as the baseline replaced a node's frame on every send. Keeps the slots bounded without advance(),
+             * and the cap bounds them even when a listen is never ended.
+             */
+            auto &ring = this->senders[chn][node];
+            auto horizon = std::min(start, this->listen_horizon(static_cast<std::size_t>(chn)));
+            while (!ring.empty()) {
+                auto *oldest = this->find_frame(ring.front());
+                if (oldest != nullptr) {
+                    if (oldest->end > horizon && ring.size() < linklayer::MAX_NODE_FRAMES) {
+                        break;
+                    }
+                    this->free_frame(*oldest);
+                }
+                ring.pop_front();
+            }
+
+            std::size_t slot;
+            if (!free.empty()) {
+                slot = free.back();
+                free.pop_back();
+            } else {
+                slot = frames.size();
+                frames.emplace_back();
+            }
+
+            /*
+             * A handle is the slot position plus a generation, so stale handles of reused slots are rejected.
+             * Generations run from 1 to 2^32 - 1, so handles are positive and never 0.
+             */
+            auto &action = frames[slot];
+            auto generation = (action.frame >> linklayer::FRAME_INDEX_BITS) %
+                              ((1ll << linklayer::FRAME_GENERATION_BITS) - 1) + 1;
+            auto frame = (generation << linklayer::FRAME_INDEX_BITS) |
+                         static_cast<long long>(slot * this->tx.size() + chn);
+
+            action = Action{Transmit, static_cast<int>(this->node_index->ids[node]), chn, start, end};
+            action.node = node;
+            action.frame = frame;
+
+            if (this->active[chn]++ == 0) {
+                this->active_bits[chn / 64] |= std::uint64_t{1} << (chn % 64);
+            }
+            push_timed(this->expiries[chn], {end, frame});
+            this->compact_expiries(static_cast<std::size_t>(chn));
+
+            ring.push_back(frame);
+
+            return frame;
+        }
+
+        Action *find_frame(long long frame) {
+            if (frame <= 0) {
+                return nullptr;
+            }
+
+            auto index = static_cast<std::size_t>(frame & linklayer::FRAME_INDEX_MASK);
+            auto chn = this->frame_channel(frame);
+            auto slot = index / this->tx.size();
+            if (slot >= this->tx[chn].size()) {
+                return nullptr;
+            }
+
+            auto &action = this->tx[chn][slot];
+            if (action.state != Transmit || action.frame != frame) {
+                return nullptr;
+            }
+
+            return &action;
+        }
+
+        int frame_channel(long long frame) const {
+            return static_cast<int>((frame & linklayer::FRAME_INDEX_MASK) % static_cast<long long>(this->tx.size()));
+        }
+
+        void set_frame_end(Action &frame, double end) {
+            if (frame.end == end) {
+                return;
+            }
+
+            frame.end = end;
+            push_timed(this->expiries[frame.chn], {end, frame.frame});
+            this->compact_expiries(static_cast<std::size_t>(frame.chn));
+        }
+
+        void free_frame(Action &frame) {
+            auto chn = static_cast<std::size_t>(frame.chn);
+            frame.state = Idle;
+            this->tx_free[chn].push_back(static_cast<std::size_t>(&frame - this->tx[chn].data()));
+
+            if (--this->active[chn] == 0) {
+                this->active_bits[chn / 64] &= ~(std::uint64_t{1} << (chn % 64));
+            }
+        }
+
+        Action *last_frame(int node, int chn) {
+            auto &ring = this->senders[chn][node];
+            while (!ring.empty()) {
+                auto *action = this->find_frame(ring.back());
+                if (action) {
+                    return action;
+                }
+                ring.pop_back();
+            }
+
+            return nullptr;
+        }
+
+        void open_listen(int node, int chn, double start, double end) {
+            auto *rx = this->find_listen(node, chn);
+            auto restarted = rx == nullptr || rx->start != start;
+            if (rx) {
+                rx->start = start;
+                rx->end = end;
+            } else {
+                this->listeners[chn][node] = static_cast<int>(this->rx[chn].size());
+                this->rx[chn].emplace_back(Listen, static_cast<int>(this->node_index->ids[node]), chn, start, end);
+                this->rx[chn].back().node = node;
+            }
+
+            if (restarted) {
+                push_timed(this->listen_starts[chn], {start, node});
+                this->compact_listen_starts(static_cast<std::size_t>(chn));
+            }
+        }
+
+        void close_listen(int node, int chn) {
+            auto &listens = this->rx[chn];
+            auto &positions = this->listeners[chn];
+            auto position = positions[node];
+            if (position < 0) {
+                return;
+            }
+
+            /* Move the last listen into its place. */
+            if (static_cast<std::size_t>(position) + 1 != listens.size()) {
+                listens[position] = listens.back();
+                positions[listens[position].node] = position;
+            }
+            listens.pop_back();
+            positions[node] = -1;
+        }
+
+        Action *find_listen(int node, int chn) {
+            auto position = this->listeners[chn][node];
+            if (position < 0) {
+                return nullptr;
+            }
+
+            return &this->rx[chn][position];
+        }
+
+        void advance_clock(const double timestamp) {
+            this->now = std::max(this->now, timestamp);
+            for (std::size_t chn = 0; chn < this->tx.size(); ++chn) {
+                this->retire(chn);
+            }
+        }
+
+        void retire(std::size_t chn) {
+            /* The watermark may not pass the start of a listen still open on the channel or a coupled one. */
+            auto horizon = std::min(this->now, this->listen_horizon(chn));
+            if (horizon > this->watermark[chn]) {
+                this->collect(chn, horizon);
+            }
+        }
+
+        /* Frames ending at or before this cannot overlap a listen open on the channel or a coupled one. */
+        double listen_horizon(std::size_t chn) {
+            auto horizon = this->earliest_listen(chn);
+            for (auto &coupled : this->coupling[chn]) {
+                horizon = std::min(horizon, this->earliest_listen(coupled.first));
+            }
+
+            return horizon;
+        }
+
+        double earliest_listen(std::size_t chn) {
+            auto &starts = this->listen_starts[chn];
+            while (!starts.empty()) {
+                auto &top = starts.front();
+                auto *listen = this->find_listen(static_cast<int>(top.second), static_cast<int>(chn));
+                if (listen && listen->start == top.first) {
+                    return top.first;
+                }
+                pop_timed(starts);  /* Closed or restarted listen. */
+            }
+
+            return std::numeric_limits<double>::infinity();
+        }
+
+        void collect(std::size_t chn, const double horizon) {
+            this->watermark[chn] = horizon;
+
+            /* A transmission ending at or before the watermark cannot overlap any open listen. */
+            auto &expiry = this->expiries[chn];
+            while (!expiry.empty() && expiry.front().first <= horizon) {
+                auto entry = expiry.front();
+                pop_timed(expiry);
+
+                auto *frame = this->find_frame(entry.second);
+                if (frame == nullptr || frame->end != entry.first) {
+                    continue;  /* Retired frame or an end that has since changed. */
+                }
+
+                this->free_frame(*frame);
+            }
+        }
+
+        /* Drop outdated entries once they outnumber the live ones, which may sit below the top indefinitely. */
+        void compact_expiries(std::size_t chn) {
+            auto &heap = this->expiries[chn];
+            if (heap.size() <= 2 * this->active[chn] + 16) {
+                return;
+            }
+
+            heap.erase(std::remove_if(heap.begin(), heap.end(), [this](const TimedEntry &entry) {
+                auto *frame = this->find_frame(entry.second);
+                return frame == nullptr || frame->end != entry.first;
+            }), heap.end());
+            std::make_heap(heap.begin(), heap.end(), std::greater<TimedEntry>{});
+        }
+
+        void compact_listen_starts(std::size_t chn) {
+            auto &heap = this->listen_starts[chn];
+            if (heap.size() <= 2 * this->rx[chn].size() + 16) {
+                return;
+            }
+
+            heap.erase(std::remove_if(heap.begin(), heap.end(), [this, chn](const TimedEntry &entry) {
+                auto *listen = this->find_listen(static_cast<int>(entry.second), static_cast<int>(chn));
+                return listen == nullptr || listen->start != entry.first;
+            }), heap.end());
+            std::make_heap(heap.begin(), heap.end(), std::greater<TimedEntry>{});
+        }
+
+        static void push_timed(TimedHeap &heap, const TimedEntry &entry) {
+            heap.push_back(entry);
+            std::push_heap(heap.begin(), heap.end(), std::greater<TimedEntry>{});
+        }
+
+        static void pop_timed(TimedHeap &heap) {
+            std::pop_heap(heap.begin(), heap.end(), std::greater<TimedEntry>{});
+            heap.pop_back();
+        }
+
+        bool is_active(int chn) const {
+            return (this->active_bits[chn / 64] >> (chn % 64)) & 1u;
+        }
+    };
+
+    /**
+     * Access to the internal state of models, defined by the tests.
+     */
+    struct ModelAccess;
+
+    /**
+     * Link model with compile-time policies, mirroring the C API without the void pointer indirection.
+     *
+     * @tparam Rng Random number engine deciding receptions
+     * @tparam Reception Reception model, see PepReception
+     */
+    template<typename Rng = std::mt19937, typename Reception = PepReception>
+    class Model : private LinkModel {
+        friend struct ModelAccess;
+
+    public:
+        Model(int nchans, std::shared_ptr<const Trace> trace) : LinkModel(nchans, std::move(trace)),
+                                                                 rng(std::random_device{}()) {}
+
+        Model(int nchans, std::shared_ptr<const Trace> trace, Rng rng) : LinkModel(nchans, std::move(trace)),
+                                                                          rng(std::move(rng)) {}
+
+        using LinkModel::index_of;
+        using LinkModel::get_link;
+
+        /**
+         * Packet error probability of t at the listener of r, interfered by the other frames in tx_list.
+         * Actions refer to nodes by index_of().
+         */
+        double should_receive(const Action &t, const Action &r, const std::vector<Action> &tx_list) {
+            return LinkModel::should_receive<Reception>(t, r, tx_list);
+        }
+
+        double pep_cache_hit_rate() const {
+            return this->pep_cache.hit_rate();
+        }
+
+        const lm_stats &get_stats() const {
+            return this->stats;
+        }
+
+        void reset_stats() {
+            this->stats = lm_stats{};
+        }
+
+        /**
+         * Restore a model saved with save_state(), sharing its trace with models still using it.
+         */
+        static std::unique_ptr<Model> load_state(std::istream &in) {
+            auto header = linklayer::read_state_header(in);
+            std::unique_ptr<Model> model{new Model{header.nchans, linklayer::load_trace(header.gpslog.c_str())}};
+
+            std::istringstream rng_state{model->restore_state(header, in)};
+            rng_state >> model->rng;
+            return model;
+        }
+
+        /**
+         * Save the dynamic state of the model, including queued events not yet applied.
+         */
+        void save_state(std::ostream &out) {
+            this->events.drain();
+
+            std::ostringstream rng_state{};
+            rng_state << this->rng;
+            LinkModel::save_state(out, rng_state.str());
+        }
+
+        bool is_connected(int x, int y, double timestamp) {
+            LM_STATS_TIME(this, is_connected);
+            this->apply_events(timestamp);
+            auto link = this->get_link(x, y, timestamp);
+            return link.id != 0ul;
+        }
+
+        long long begin_send(int id, int chn, double timestamp, double duration) {
+            if (this->events.enabled()) {
+                this->events.push({linklayer::BeginSend, id, chn, 0, timestamp, duration});
+                return 0;
+            }
+
+            LM_STATS_TIME(this, begin_send);
+            return this->send_frame(id, chn, timestamp, duration);
+        }
+
+        void end_send(int id, int chn, double timestamp) {
+            if (this->events.enabled()) {
+                this->events.push({linklayer::EndSend, id, chn, 0, timestamp});
+                return;
+            }
+
+            LM_STATS_TIME(this, end_send);
+            this->stop_send(id, chn, timestamp);
+        }
+
+        void end_frame(long long frame, double timestamp) {
+            if (this->events.enabled()) {
+                this->events.push({linklayer::EndFrame, 0, 0, frame, timestamp});
+                return;
+            }
+
+            LM_STATS_TIME(this, end_send);
+            this->stop_frame(frame, timestamp);
+        }
+
+        void begin_listen(int id, int chn, double timestamp, double duration) {
+            if (this->events.enabled()) {
+                this->events.push({linklayer::BeginListen, id, chn, 0, timestamp, duration});
+                return;
+            }
+
+            LM_STATS_TIME(this, begin_listen);
+            this->listen(id, chn, timestamp, duration);
+        }
+
+        int status(int id, int chn, double timestamp) {
+            LM_STATS_TIME(this, status);
+            this->apply_events(timestamp);
+
+            if (this->tx[chn].empty()) {
+                return linklayer::LM_ERROR;
+            }
+
+            auto node = this->index_of(id);
+            auto *listen = node < 0 ? nullptr : this->find_listen(node, chn);
+            if (listen == nullptr) {
+                return linklayer::LM_ERROR;
+            }
+
+            auto &rx = *listen;
+            auto original_time = rx.end;
+            rx.end = timestamp;
+
+            auto result = this->process_listen(chn, rx);
+            rx.end = original_time;
+            this->follow_clock(timestamp, chn);
+            return result;
+        }
+
+        int end_listen(int id, int chn, double timestamp) {
+            LM_STATS_TIME(this, end_listen);
+            this->apply_events(timestamp);
+
+            auto node = this->index_of(id);
+            auto *listen = node < 0 ? nullptr : this->find_listen(node, chn);
+            if (listen == nullptr) {
+                return linklayer::LM_ERROR;
+            }
+
+            auto &rx = *listen;
+            rx.end = timestamp;
+
+            auto result = this->tx[chn].empty() ? linklayer::LM_ERROR : this->process_listen(chn, rx);
+            this->close_listen(node, chn);
+            this->follow_clock(timestamp, chn);
+            return result;
+        }
+
+        std::vector<int> alive_nodes(double timestamp) {
+            LM_STATS_TIME(this, alive_nodes);
+            this->apply_events(timestamp);
+            auto &topology = this->get_topology(timestamp);
+            std::set<unsigned long> node_ids{};
+
+            for (auto &link : topology.links) {
+                node_ids.emplace(link.nodes.first);
+                node_ids.emplace(link.nodes.second);
+            }
+
+            return std::vector<int>(node_ids.begin(), node_ids.end());
+        }
+
+        void advance(double timestamp) {
+            this->apply_events(timestamp);
+            this->advance_clock(timestamp);
+        }
+
+        void set_auto_advance(bool enabled) {
+            this->auto_advance = enabled;
+        }
+
+        void set_pep_cache(std::size_t capacity) {
+            this->pep_cache.set_capacity(capacity);
+        }
+
+        /**
+         * Set the attenuation in dB of interference between two channels.
+         * Attenuations of NEGLIGIBLE_COUPLING or more remove the coupling.
+         */
+        void set_channel_coupling(int a, int b, double attenuation) {
+            auto nchans = static_cast<int>(this->tx.size());
+            if (a < 0 || b < 0 || a >= nchans || b >= nchans || a == b || std::isnan(attenuation)) {
+                return;
+            }
+
+            for (auto &pair : {std::make_pair(a, b), std::make_pair(b, a)}) {
+                auto &row = this->coupling[pair.first];
+                row.erase(std::remove_if(row.begin(), row.end(), [&pair](const std::pair<int, double> &c) {
+                    return c.first == pair.second;
+                }), row.end());
+
+                if (attenuation < linklayer::NEGLIGIBLE_COUPLING) {
+                    row.emplace_back(pair.second, attenuation);
+                }
+            }
+        }
+
+        void set_queued(bool enabled) {
+            this->events.enable(enabled);
+            if (!enabled) {
+                this->apply_events();
+            }
+        }
+
+    private:
+        Rng rng;
+
+        /*
+         * Apply queued events up to a query's timestamp, so it sees a consistent view.
+         * Later events stay queued, as applying them could retire actions the query still needs.
+         */
+        void apply_events(double until = std::numeric_limits<double>::infinity()) {
+            if (this->events.empty()) {
+                return;
+            }
+
+            /* Queued calls are counted, and timed, when they are applied. */
+            for (auto &event : this->events.take(until)) {
+                switch (event.type) {
+                    case linklayer::BeginSend: {
+                        LM_STATS_TIME(this, begin_send);
+                        this->send_frame(event.id, event.chn, event.timestamp, event.duration);
+                        break;
+                    }
+                    case linklayer::EndSend: {
+                        LM_STATS_TIME(this, end_send);
+                        this->stop_send(event.id, event.chn, event.timestamp);
+                        break;
+                    }
+                    case linklayer::EndFrame: {
+                        LM_STATS_TIME(this, end_send);
+                        this->stop_frame(event.frame, event.timestamp);
+                        break;
+                    }
+                    case linklayer::BeginListen: {
+                        LM_STATS_TIME(this, begin_listen);
+                        this->listen(event.id, event.chn, event.timestamp, event.duration);
+                        break;
+                    }
+                }
+            }
+        }
+
+        /* Advance the clock with the timestamp of a call if the caller promised monotone timestamps. */
+        void follow_clock(double timestamp, int chn) {
+            if (this->auto_advance) {
+                this->now = std::max(this->now, timestamp);
+                this->retire(static_cast<std::size_t>(chn));
+            }
+        }
+
+        long long send_frame(int id, int chn, double timestamp, double duration) {
+            this->follow_clock(timestamp, chn);
+
+            auto node = this->index_of(id);
+            if (node < 0) {
+                return linklayer::LM_ERROR;
+            }
+
+            return this->begin_frame(node, chn, timestamp, timestamp + duration);
+        }
+
+        void stop_send(int id, int chn, double timestamp) {
+            this->follow_clock(timestamp, chn);
+
+            auto node = this->index_of(id);
+            if (node < 0) {
+                return;
+            }
+
+            auto *tx = this->last_frame(node, chn);
+            if (tx) {
+                this->set_frame_end(*tx, timestamp);
+            }
+        }
+
+        void stop_frame(long long frame, double timestamp) {
+            if (frame > 0) {
+                this->follow_clock(timestamp, this->frame_channel(frame));
+            }
+
+            auto *tx = this->find_frame(frame);
+            if (tx) {
+                this->set_frame_end(*tx, timestamp);
+            }
+        }
+
+        void listen(int id, int chn, double timestamp, double duration) {
+            this->follow_clock(timestamp, chn);
+
+            auto node = this->index_of(id);
+            if (node < 0) {
+                return;
+            }
+
+            this->open_listen(node, chn, timestamp, timestamp + duration);
+        }
+
+        int process_listen(int chn, Action &rx) {
+            std::vector<Action> tx_list{};
+            for (auto &tx : this->tx[chn]) {
+                if (tx.state == Transmit && tx.is_within(rx)) {
+                    tx_list.push_back(tx);
+                }
+            }
+
+            if (tx_list.size() == 1) {
+                /* Only one transmitting node. */
+                auto pep = this->should_receive(tx_list.back(), rx, this->tx[chn]);
+                std::bernoulli_distribution d{1.0 - pep};
+
+                if (d(this->rng)) {
+                    return tx_list.back().id;
+                }
+            } else {
+                std::vector<std::pair<unsigned long, double>> peps(tx_list.size());
+                for (std::size_t c = 0; c < tx_list.size(); ++c) {
+                    auto &tx = tx_list[c];
+                    peps[c] = std::make_pair(tx.id, this->should_receive(tx, rx, tx_list));
+                }
+
+                auto pep = std::min_element(peps.begin(), peps.end());
+                if (pep == peps.end()) {
+                    return linklayer::LM_ERROR;
+                }
+
+                std::bernoulli_distribution d{1.0 - (*pep).second};
+                if (d(this->rng)) {
+                    return (*pep).first;
+                }
+            }
+
+            return linklayer::LM_ERROR;
+        }
+    };
+
+    using DefaultModel = Model<>;
+}
+
+
+#endif /* LINKLAYER_MODEL_H */
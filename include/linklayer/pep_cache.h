@@ -0,0 +1,147 @@
+#ifndef LINKLAYER_PEP_CACHE_H
+#define LINKLAYER_PEP_CACHE_H
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace linklayer {
+
+    /**
+     * Key of a packet error probability: the topology epoch of the transmission, the transmitting
+     * and receiving node indices, and the interferers as sorted (node index, epoch, attenuation) tuples.
+     */
+    struct PepKey {
+        double epoch{};
+        std::size_t tx{};
+        std::size_t rx{};
+        std::vector<std::tuple<std::size_t, double, double>> interferers{};
+
+        bool operator==(const PepKey &rhs) const {
+            return epoch == rhs.epoch && tx == rhs.tx && rx == rhs.rx && interferers == rhs.interferers;
+        }
+
+        std::size_t hash() const {
+            auto seed = std::hash<double>{}(epoch);
+            auto combine = [&seed](std::size_t value) {
+                seed ^= value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2);
+            };
+
+            combine(tx);
+            combine(rx);
+            for (auto &interferer : interferers) {
+                combine(std::get<0>(interferer));
+                combine(std::hash<double>{}(std::get<1>(interferer)));
+                combine(std::hash<double>{}(std::get<2>(interferer)));
+            }
+
+            return seed;
+        }
+    };
+
+    /**
+     * Bounded least-recently-used cache of packet error probabilities. Disabled at capacity 0.
+     */
+    class PepCache {
+    public:
+        PepCache() = default;
+
+        PepCache(const PepCache &other) : hits(other.hits), misses(other.misses), limit(other.limit) {
+            /* Rebuild the index, as it refers to entries of the list it was built for. */
+            for (auto it = other.entries.rbegin(); it != other.entries.rend(); ++it) {
+                this->insert(it->key, it->hash, it->pep);
+            }
+        }
+
+        PepCache &operator=(const PepCache &other) = delete;
+
+        bool enabled() const {
+            return limit > 0;
+        }
+
+        std::size_t capacity() const {
+            return limit;
+        }
+
+        std::size_t size() const {
+            return entries.size();
+        }
+
+        void set_capacity(std::size_t capacity) {
+            limit = capacity;
+            while (entries.size() > limit) {
+                this->evict();
+            }
+        }
+
+        /**
+         * Look up a cached probability, marking it as most recently used.
+         * @return Pointer to the probability, or nullptr on a miss
+         */
+        const double *find(const PepKey &key, std::size_t hash) {
+            auto range = index.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (it->second->key == key) {
+                    entries.splice(entries.begin(), entries, it->second);
+                    hits++;
+                    return &it->second->pep;
+                }
+            }
+
+            misses++;
+            return nullptr;
+        }
+
+        void insert(PepKey key, std::size_t hash, double pep) {
+            if (!this->enabled()) {
+                return;
+            }
+
+            if (entries.size() >= limit) {
+                this->evict();
+            }
+
+            entries.push_front({std::move(key), hash, pep});
+            index.emplace(hash, entries.begin());
+        }
+
+        double hit_rate() const {
+            auto lookups = hits + misses;
+            return lookups == 0 ? 0.0 : static_cast<double>(hits) / static_cast<double>(lookups);
+        }
+
+        unsigned long long hits{};
+        unsigned long long misses{};
+
+    private:
+        struct Entry {
+            PepKey key;
+            std::size_t hash;
+            double pep;
+        };
+
+        std::size_t limit{};
+        std::list<Entry> entries{};  /* Most recently used first. */
+        std::unordered_multimap<std::size_t, std::list<Entry>::iterator> index{};
+
+        void evict() {
+            auto &entry = entries.back();
+            auto range = index.equal_range(entry.hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                if (it->second == std::prev(entries.end())) {
+                    index.erase(it);
+                    break;
+                }
+            }
+            entries.pop_back();
+        }
+    };
+
+}
+
+#endif /* LINKLAYER_PEP_CACHE_H */
@@ -0,0 +1,72 @@
+#ifndef LINKLAYER_RING_H
+#define LINKLAYER_RING_H
+
+#include <cstddef>
+#include <vector>
+
+namespace linklayer {
+
+    /**
+     * Double-ended ring buffer that grows when full and never shrinks.
+     */
+    template<typename T>
+    class RingBuffer {
+    public:
+        bool empty() const {
+            return count == 0;
+        }
+
+        std::size_t size() const {
+            return count;
+        }
+
+        T &front() {
+            return buffer[head];
+        }
+
+        T &back() {
+            return buffer[(head + count - 1) % buffer.size()];
+        }
+
+        /* Element i from the front. */
+        const T &operator[](std::size_t i) const {
+            return buffer[(head + i) % buffer.size()];
+        }
+
+        void push_back(const T &value) {
+            if (count == buffer.size()) {
+                grow();
+            }
+
+            buffer[(head + count) % buffer.size()] = value;
+            count++;
+        }
+
+        void pop_front() {
+            head = (head + 1) % buffer.size();
+            count--;
+        }
+
+        void pop_back() {
+            count--;
+        }
+
+    private:
+        std::vector<T> buffer{};
+        std::size_t head{};
+        std::size_t count{};
+
+        void grow() {
+            std::vector<T> grown(buffer.empty() ? 4 : buffer.size() * 2);
+            for (std::size_t i = 0; i < count; ++i) {
+                grown[i] = buffer[(head + i) % buffer.size()];
+            }
+
+            buffer = std::move(grown);
+            head = 0;
+        }
+    };
+
+}
+
+#endif /* LINKLAYER_RING_H */
@@ -0,0 +1,44 @@
+#ifndef LINKLAYER_STATS_H
+#define LINKLAYER_STATS_H
+
+#include <chrono>
+
+#include <linklayer/linkmodel.h>
+
+namespace linklayer {
+
+    /**
+     * Adds the wall time spent in its scope to an API function's counters.
+     */
+    class ScopedTimer {
+    public:
+        explicit ScopedTimer(lm_call_stats &call) : call(call), begin(std::chrono::steady_clock::now()) {}
+
+        ~ScopedTimer() {
+            auto elapsed = std::chrono::steady_clock::now() - begin;
+            call.calls++;
+            call.nanoseconds += static_cast<unsigned long long>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        }
+
+        ScopedTimer(const ScopedTimer &) = delete;
+
+        ScopedTimer &operator=(const ScopedTimer &) = delete;
+
+    private:
+        lm_call_stats &call;
+        std::chrono::steady_clock::time_point begin;
+    };
+
+}
+
+/* Counters are only maintained when built with -DLINKLAYER_STATS=ON, which also defines LINKLAYER_STATS for consumers. */
+#ifdef LINKLAYER_STATS
+#define LM_STATS_ADD(lm, counter, n) ((lm)->stats.counter += (n))
+#define LM_STATS_TIME(lm, function) linklayer::ScopedTimer lm_stats_timer_{(lm)->stats.function}
+#else
+#define LM_STATS_ADD(lm, counter, n) ((void) 0)
+#define LM_STATS_TIME(lm, function) ((void) 0)
+#endif
+
+#endif /* LINKLAYER_STATS_H */
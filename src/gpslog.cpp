@@ -1,11 +1,12 @@
 #include <fstream>
 #include <common/strings.h>
 #include <algorithm>
+#include <unordered_map>
 
 #include "gpslog.h"
 
-linklayer::NodeMap parse_gpsfile(const char *gpslog) {
-    linklayer::NodeMap nodes{};
+linklayer::NodeList parse_gpsfile(const char *gpslog) {
+    std::unordered_map<unsigned long, linklayer::Node> nodes{};
     std::ifstream logfile{gpslog};
 
     if (!logfile.is_open()) {
@@ -40,16 +41,52 @@ linklayer::NodeMap parse_gpsfile(const char *gpslog) {
             tokens.pop_front();
             auto rssi = std::stod(tokens.front());
             tokens.pop_front();
-            location.connections[n_id] = rssi;
+            location.connections.emplace_back(n_id, rssi); /* Identifier until remapped below. */
         }
     }
 
     logfile.close();
 
+    /* Assign dense indices in order of node identifier. */
+    linklayer::NodeList node_list{};
+    node_list.reserve(nodes.size());
     for (auto &item : nodes) {
-        auto &node = item.second;
+        node_list.push_back(std::move(item.second));
+    }
+    std::sort(node_list.begin(), node_list.end(), [](const linklayer::Node &a, const linklayer::Node &b) {
+        return a.id < b.id;
+    });
+
+    std::unordered_map<unsigned long, std::size_t> index{};
+    for (std::size_t i = 0; i < node_list.size(); ++i) {
+        index[node_list[i].id] = i;
+    }
+
+    for (auto &node : node_list) {
         std::sort(node.location_history.begin(), node.location_history.end());
+
+        for (auto &location : node.location_history) {
+            /* Later entries for the same neighbour take precedence. */
+            std::vector<std::pair<std::size_t, double>> connections{};
+            for (auto it = location.connections.rbegin(); it != location.connections.rend(); ++it) {
+                auto n = index.find(it->first);
+                if (n != index.end()) {
+                    connections.emplace_back(n->second, it->second);
+                }
+            }
+
+            std::stable_sort(connections.begin(), connections.end(),
+                             [](const std::pair<std::size_t, double> &a, const std::pair<std::size_t, double> &b) {
+                                 return a.first < b.first;
+                             });
+            connections.erase(std::unique(connections.begin(), connections.end(),
+                                          [](const std::pair<std::size_t, double> &a,
+                                             const std::pair<std::size_t, double> &b) {
+                                              return a.first == b.first;
+                                          }), connections.end());
+            location.connections = std::move(connections);
+        }
     }
 
-    return nodes;
+    return node_list;
 }
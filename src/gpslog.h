@@ -3,9 +3,9 @@
 
 #include <unordered_map>
 
-#include "model.h"
+#include "trace.h"
 
-linklayer::NodeMap parse_gpsfile(const char *gpslog);
+linklayer::NodeList parse_gpsfile(const char *gpslog);
 
 
 #endif /* LINKLAYER_GPSLOG_H */
@@ -1,14 +1,9 @@
 #include <iostream>
+#include <fstream>
 #include <algorithm>
-#include <iterator>
-#include <set>
 
 #include <linklayer/linkmodel.h>
-
-#include <common/iters.h>
-
-#include "model.h"
-#include "gpslog.h"
+#include <linklayer/model.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -20,21 +15,16 @@ void *initialize(int nchans, const char *gpslog) {
     }
 
     /* Parse GPS log. */
-    linklayer::NodeMap node_map;
+    std::shared_ptr<const linklayer::Trace> trace;
     try {
-        node_map = parse_gpsfile(gpslog);
+        trace = linklayer::load_trace(gpslog);
     } catch (const std::exception &e) {
         std::cerr << e.what() << std::endl;
         return nullptr;
     }
 
-    if (node_map.empty()) {
-        std::cerr << "failed to parse gpslog file" << std::endl;
-        return nullptr;
-    }
-
     /* Return model as void pointer. */
-    auto *lm = new linklayer::LinkModel{nchans, node_map};
+    auto *lm = new linklayer::DefaultModel{nchans, std::move(trace)};
     return static_cast<void *>(lm);
 }
 
@@ -43,146 +33,157 @@ void deinit(void *model) {
         return;
     }
 
-    auto *lm = static_cast<linklayer::LinkModel *>(model);
+    auto *lm = static_cast<linklayer::DefaultModel *>(model);
     delete lm;
 }
 
 bool is_connected(void *model, int x, int y, double timestamp) {
-    auto *lm = static_cast<linklayer::LinkModel *>(model);
-    auto &link = lm->get_link(x, y, timestamp);
-    return link.id != 0ul;
-
+    return static_cast<linklayer::DefaultModel *>(model)->is_connected(x, y, timestamp);
 }
 
-void begin_send(void *model, int id, int chn, double timestamp, double duration) {
-    auto *lm = static_cast<linklayer::LinkModel *>(model);
-    auto it = std::find(lm->tx[chn].begin(), lm->tx[chn].end(), linklayer::Action{linklayer::Transmit, id, chn});
-    if (it != lm->tx[chn].end()) {
-        auto &tx = *it;
-        tx.start = timestamp;
-        tx.end = timestamp + duration;
-    } else {
-        lm->tx[chn].emplace_back(linklayer::Transmit, id, chn, timestamp, timestamp + duration);
-    }
+long long begin_send(void *model, int id, int chn, double timestamp, double duration) {
+    return static_cast<linklayer::DefaultModel *>(model)->begin_send(id, chn, timestamp, duration);
 }
 
 void end_send(void *model, int id, int chn, double timestamp) {
-    auto *lm = static_cast<linklayer::LinkModel *>(model);
-    auto it = std::find(lm->tx[chn].begin(), lm->tx[chn].end(), linklayer::Action{linklayer::Transmit, id, chn});
-    if (it != lm->tx[chn].end()) {
-        auto &tx = *it;
-        tx.end = timestamp;
-    }
+    static_cast<linklayer::DefaultModel *>(model)->end_send(id, chn, timestamp);
+}
+
+void end_frame(void *model, long long frame, double timestamp) {
+    static_cast<linklayer::DefaultModel *>(model)->end_frame(frame, timestamp);
 }
 
 void begin_listen(void *model, int id, int chn, double timestamp, double duration) {
-    auto *lm = static_cast<linklayer::LinkModel *>(model);
-    auto it = std::find(lm->rx[chn].begin(), lm->rx[chn].end(), linklayer::Action{linklayer::Listen, id, chn});
-    if (it != lm->rx[chn].end()) {
-        auto &rx = *it;
-        rx.start = timestamp;
-        rx.end = timestamp + duration;
-    } else {
-        lm->rx[chn].emplace_back(linklayer::Listen, id, chn, timestamp, timestamp + duration);
-    }
+    static_cast<linklayer::DefaultModel *>(model)->begin_listen(id, chn, timestamp, duration);
 }
 
-static int process_listen(linklayer::LinkModel *lm, int chn, linklayer::Action &rx) {
-    std::random_device rd{};
-    std::mt19937 gen{rd()};
+int status(void *model, int id, int chn, double timestamp) {
+    return static_cast<linklayer::DefaultModel *>(model)->status(id, chn, timestamp);
+}
 
-    std::vector<linklayer::Action> tx_list{};
-    for (auto &tx : lm->tx[chn]) {
-        if (tx.is_within(rx)) {
-            tx_list.push_back(tx);
-        }
+int end_listen(void *model, int id, int chn, double timestamp) {
+    return static_cast<linklayer::DefaultModel *>(model)->end_listen(id, chn, timestamp);
+}
+
+void advance(void *model, double timestamp) {
+    if (model == nullptr) {
+        return;
     }
 
-    if (tx_list.size() == 1) {
-        /* Only one transmitting node. */
-        auto pep = lm->should_receive(tx_list.back(), rx, lm->tx[chn]);
-        std::bernoulli_distribution d{1.0 - pep};
+    static_cast<linklayer::DefaultModel *>(model)->advance(timestamp);
+}
 
-        if (d(gen)) {
-            return tx_list.back().id;
-        }
-    } else {
-        std::vector<std::pair<unsigned long, double>> peps(tx_list.size());
-        common::enumerate(tx_list.begin(), tx_list.end(), 0, [&lm, &rx, &tx_list, &peps](int c, linklayer::Action tx) {
-            peps[c] = std::make_pair(tx.id, lm->should_receive(tx, rx, tx_list));
-        });
-
-        auto pep = std::min_element(peps.begin(), peps.end());
-        if (pep == peps.end()) {
-            return linklayer::LM_ERROR;
-        }
+void set_auto_advance(void *model, bool enabled) {
+    if (model == nullptr) {
+        return;
+    }
 
-        std::bernoulli_distribution d{1.0 - (*pep).second};
-        if (d(gen)) {
-            return (*pep).first;
-        }
+    static_cast<linklayer::DefaultModel *>(model)->set_auto_advance(enabled);
+}
+
+void set_queued(void *model, bool enabled) {
+    if (model == nullptr) {
+        return;
     }
 
-    return linklayer::LM_ERROR;
+    static_cast<linklayer::DefaultModel *>(model)->set_queued(enabled);
 }
 
-int status(void *model, int id, int chn, double timestamp) {
-    auto *lm = static_cast<linklayer::LinkModel *>(model);
+void set_pep_cache(void *model, unsigned long capacity) {
+    if (model == nullptr) {
+        return;
+    }
 
-    if (lm->tx[chn].empty()) {
-        return linklayer::LM_ERROR;
+    static_cast<linklayer::DefaultModel *>(model)->set_pep_cache(capacity);
+}
+
+void set_channel_coupling(void *model, int a, int b, double attenuation) {
+    if (model == nullptr) {
+        return;
     }
 
-    auto it = std::find(lm->rx[chn].begin(), lm->rx[chn].end(), linklayer::Action{linklayer::Listen, id, chn});
-    if (it == lm->rx[chn].end()) {
-        return linklayer::LM_ERROR;
+    static_cast<linklayer::DefaultModel *>(model)->set_channel_coupling(a, b, attenuation);
+}
+
+double pep_cache_hit_rate(void *model) {
+    if (model == nullptr) {
+        return 0.0;
     }
 
-    auto &rx = *it;
-    auto original_time = rx.end;
-    rx.end = timestamp;
+    return static_cast<linklayer::DefaultModel *>(model)->pep_cache_hit_rate();
+}
+
+int *alive_nodes(void *model, double timestamp, int *node_count) {
+    auto node_ids = static_cast<linklayer::DefaultModel *>(model)->alive_nodes(timestamp);
+
+    *node_count = static_cast<int>(node_ids.size());
+    auto nodes = new int[node_ids.size()];
+    std::copy(node_ids.begin(), node_ids.end(), nodes);
 
-    auto result = process_listen(lm, chn, rx);
-    rx.end = original_time;
-    return result;
+    return nodes;
 }
 
-int end_listen(void *model, int id, int chn, double timestamp) {
-    auto *lm = static_cast<linklayer::LinkModel *>(model);
+bool save_state(void *model, const char *path) {
+    if (model == nullptr || path == nullptr) {
+        return false;
+    }
+
+    try {
+        std::ofstream out{path, std::ios::binary};
+        if (!out) {
+            throw std::runtime_error("failed to open state file");
+        }
 
-    if (lm->tx[chn].empty()) {
-        return linklayer::LM_ERROR;
+        static_cast<linklayer::DefaultModel *>(model)->save_state(out);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return false;
     }
 
-    auto it = std::find(lm->rx[chn].begin(), lm->rx[chn].end(), linklayer::Action{linklayer::Listen, id, chn});
-    if (it == lm->rx[chn].end()) {
-        return linklayer::LM_ERROR;
+    return true;
+}
+
+void *load_state(const char *path) {
+    if (path == nullptr) {
+        return nullptr;
     }
 
-    auto &rx = *it;
-    rx.end = timestamp;
+    try {
+        std::ifstream in{path, std::ios::binary};
+        if (!in) {
+            throw std::runtime_error("failed to open state file");
+        }
 
-    return process_listen(lm, chn, rx);
+        return static_cast<void *>(linklayer::DefaultModel::load_state(in).release());
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return nullptr;
+    }
 }
 
-int *alive_nodes(void *model, double timestamp, int *node_count) {
-    auto *lm = static_cast<linklayer::LinkModel *>(model);
-    auto &topology = lm->get_topology(timestamp);
-    std::set<unsigned long> node_ids{};
-
-    for (auto &link : topology.links) {
-        node_ids.emplace(link.nodes.first.id);
-        node_ids.emplace(link.nodes.second.id);
+bool get_stats(void *model, struct lm_stats *stats) {
+    if (model == nullptr || stats == nullptr) {
+        return false;
     }
 
-    *node_count = static_cast<int>(node_ids.size());
-    auto nodes = new int[node_ids.size()];
-    std::copy(node_ids.begin(), node_ids.end(), nodes);
+#ifdef LINKLAYER_STATS
+    *stats = static_cast<linklayer::DefaultModel *>(model)->get_stats();
+    return true;
+#else
+    *stats = lm_stats{};
+    return false;
+#endif
+}
 
-    return nodes;
+void reset_stats(void *model) {
+    if (model == nullptr) {
+        return;
+    }
+
+    static_cast<linklayer::DefaultModel *>(model)->reset_stats();
 }
 
 #ifdef __cplusplus
 }
 
-#endif
\ No newline at end of file
+#endif
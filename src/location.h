@@ -1,7 +1,9 @@
 #ifndef LINKLAYER_LOCATION_H
 #define LINKLAYER_LOCATION_H
 
-#include <unordered_map>
+#include <cstddef>
+#include <utility>
+#include <vector>
 
 #include <geo/location.h>
 
@@ -12,7 +14,7 @@ namespace linklayer {
 
         Location(double time, double latitude, double longitude) : geo::Location(time, latitude, longitude) {}
 
-        std::unordered_map<unsigned long, double> connections{};
+        std::vector<std::pair<std::size_t, double>> connections{};  /* Neighbour index and RSSI, sorted by index. */
     };
 
 }
@@ -1,130 +1,510 @@
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
 
 #include <common/equality.h>
 #include <common/helpers.h>
 
-#include "model.h"
+#include "trace.h"
+#include "gpslog.h"
 
-const linklayer::Link linklayer::LinkModel::get_link(int x, int y, double timestamp) {
-    auto &topology = this->get_topology(timestamp);
+bool linklayer::TimeLess::operator()(double lhs, double rhs) const {
+    return common::is_less<double>{}(lhs, rhs);
+}
 
-    for (const auto &link : topology.links) {
-        auto &node_pair = link.nodes;
-        if (((node_pair.first.id == x && node_pair.second.id == y) ||
-             (node_pair.first.id == y && node_pair.second.id == x))) {
-            return link;
+namespace {
+    /* FNV-1a over the bytes of a value. */
+    template<typename T>
+    void fingerprint(std::uint64_t &hash, const T &value) {
+        unsigned char bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T));
+        for (auto byte : bytes) {
+            hash = (hash ^ byte) * 0x100000001b3ull;
         }
     }
 
-    return linklayer::Link{}; /* No link found. */
+    std::uint64_t fingerprint(const linklayer::NodeList &nodes) {
+        std::uint64_t hash = 0xcbf29ce484222325ull;
+        for (auto &node : nodes) {
+            fingerprint(hash, node.id);
+            for (auto &location : node.location_history) {
+                fingerprint(hash, location.get_time());
+                fingerprint(hash, location.get_latitude());
+                fingerprint(hash, location.get_longitude());
+                for (auto &connection : location.connections) {
+                    fingerprint(hash, connection.first);
+                    fingerprint(hash, connection.second);
+                }
+            }
+        }
+
+        return hash;
+    }
 }
 
-double linklayer::LinkModel::should_receive(const Action &t, const Action &r, const std::vector<Action> &tx_list) {
-    auto &link = this->get_link(t.id, r.id, t.start);
-    if (link.id == 0ull || common::is_zero(link.rssi)) {
-        /* No link. */
-        return false;
+std::shared_ptr<const linklayer::Trace> linklayer::load_trace(const char *gpslog) {
+    /* Traces in use by canonical path, so models restored from saved states share them. */
+    static std::mutex mutex{};
+    static std::map<std::string, std::weak_ptr<const linklayer::Trace>> traces{};
+
+    char resolved[PATH_MAX];
+    std::string path = ::realpath(gpslog, resolved) ? resolved : gpslog;
+
+    std::lock_guard<std::mutex> lock{mutex};
+    if (auto shared = traces[path].lock()) {
+        return shared;
     }
 
-    std::vector<double> interference{};
-    auto rssi = link.rssi;
+    auto trace = std::make_shared<linklayer::Trace>();
+    trace->gpslog = path;
+    trace->nodes = parse_gpsfile(path.c_str());
 
-    for (auto &tx_i : tx_list) {
-        if (tx_i.id == t.id) {
-            /* No interference from own transmission. */
-            continue;
+    if (trace->nodes.empty()) {
+        throw std::runtime_error("failed to parse gpslog file");
+    }
+
+    trace->fingerprint = fingerprint(trace->nodes);
+
+    /* Map node identifiers to dense indices. */
+    auto &index = trace->index;
+    index.ids.reserve(trace->nodes.size());
+    for (auto &node : trace->nodes) {
+        index.ids.push_back(node.id);
+    }
+
+    auto max_id = index.ids.empty() ? 0ul : index.ids.back();
+    index.table.assign(std::min(max_id, linklayer::MAX_TABLE_ID) + 1, -1);
+    for (std::size_t i = 0; i < index.ids.size(); ++i) {
+        if (index.ids[i] < index.table.size()) {
+            index.table[index.ids[i]] = static_cast<int>(i);
         }
+    }
 
-        if (t.end <= tx_i.start || t.start >= tx_i.end) {
-            /* Time interval does not intersect. */
-            continue;
+    traces[path] = trace;
+    return trace;
+}
+
+namespace {
+    const std::uint32_t STATE_MAGIC = 0x4c4d5354;  /* "LMST" */
+    const std::uint32_t STATE_VERSION = 1;
+
+    template<typename T>
+    void write(std::ostream &out, const T &value) {
+        out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+    }
+
+    template<typename T>
+    T read(std::istream &in) {
+        T value{};
+        if (!in.read(reinterpret_cast<char *>(&value), sizeof(T))) {
+            throw std::runtime_error("truncated model state");
         }
+        return value;
+    }
+
+    void write_string(std::ostream &out, const std::string &value) {
+        write<std::uint64_t>(out, value.size());
+        out.write(value.data(), static_cast<std::streamsize>(value.size()));
+    }
 
-        auto &link_i = this->get_link(tx_i.id, r.id, tx_i.start);
-        if (link_i.id == 0ull || common::is_zero(link_i.rssi)) {
+    std::string read_string(std::istream &in) {
+        std::string value(read<std::uint64_t>(in), '\0');
+        if (!in.read(&value[0], static_cast<std::streamsize>(value.size()))) {
+            throw std::runtime_error("truncated model state");
+        }
+        return value;
+    }
+
+    void write_actions(std::ostream &out, const std::vector<linklayer::Action> &actions) {
+        write<std::uint64_t>(out, actions.size());
+        for (auto &action : actions) {
+            write<std::uint8_t>(out, action.state);
+            write<std::int32_t>(out, action.id);
+            write<std::int32_t>(out, action.node);
+            write<std::int32_t>(out, action.chn);
+            write<std::int64_t>(out, action.frame);
+            write<double>(out, action.start);
+            write<double>(out, action.end);
+        }
+    }
+
+    std::vector<linklayer::Action> read_actions(std::istream &in, std::size_t nodes) {
+        std::vector<linklayer::Action> actions(read<std::uint64_t>(in));
+        for (auto &action : actions) {
+            action.state = static_cast<linklayer::State>(read<std::uint8_t>(in));
+            action.id = read<std::int32_t>(in);
+            action.node = read<std::int32_t>(in);
+            action.chn = read<std::int32_t>(in);
+            action.frame = read<std::int64_t>(in);
+            action.start = read<double>(in);
+            action.end = read<double>(in);
+
+            if (action.state > linklayer::Transmit || action.node < 0 || static_cast<std::size_t>(action.node) >= nodes) {
+                throw std::runtime_error("malformed model state");
+            }
+        }
+        return actions;
+    }
+}
+
+linklayer::StateHeader linklayer::read_state_header(std::istream &in) {
+    if (read<std::uint32_t>(in) != STATE_MAGIC || read<std::uint32_t>(in) != STATE_VERSION) {
+        throw std::runtime_error("not a model state");
+    }
+
+    linklayer::StateHeader header{};
+    header.gpslog = read_string(in);
+    header.fingerprint = read<std::uint64_t>(in);
+    header.nchans = read<std::int32_t>(in);
+    if (header.nchans <= 0) {
+        throw std::runtime_error("malformed model state");
+    }
+
+    return header;
+}
+
+void linklayer::LinkModel::save_state(std::ostream &out, const std::string &rng) const {
+    const auto nchans = this->tx.size();
+
+    write<std::uint32_t>(out, STATE_MAGIC);
+    write<std::uint32_t>(out, STATE_VERSION);
+    write_string(out, this->trace->gpslog);
+    write<std::uint64_t>(out, this->trace->fingerprint);
+    write<std::int32_t>(out, static_cast<std::int32_t>(nchans));
+    write<std::uint64_t>(out, this->node_index->ids.size());
+
+    /* Settings. */
+    write<std::uint8_t>(out, this->events.enabled());
+    write<std::uint64_t>(out, this->events.waiting().size());
+    for (auto &event : this->events.waiting()) {
+        write<std::uint8_t>(out, event.type);
+        write<std::int32_t>(out, event.id);
+        write<std::int32_t>(out, event.chn);
+        write<std::int64_t>(out, event.frame);
+        write<double>(out, event.timestamp);
+        write<double>(out, event.duration);
+        write<std::uint64_t>(out, event.sequence);
+    }
+    write<std::uint8_t>(out, this->auto_advance);
+    write<std::uint64_t>(out, this->pep_cache.capacity());
+    for (auto &row : this->coupling) {
+        write<std::uint64_t>(out, row.size());
+        for (auto &coupled : row) {
+            write<std::int32_t>(out, coupled.first);
+            write<double>(out, coupled.second);
+        }
+    }
+
+    /* Frames and listens, listener positions and active channels follow from them. */
+    write<double>(out, this->now);
+    for (std::size_t chn = 0; chn < nchans; ++chn) {
+        write<double>(out, this->watermark[chn]);
+        write_actions(out, this->tx[chn]);
+        write_actions(out, this->rx[chn]);
+
+        write<std::uint64_t>(out, this->tx_free[chn].size());
+        for (auto slot : this->tx_free[chn]) {
+            write<std::uint64_t>(out, slot);
+        }
+
+        for (auto &frames : this->senders[chn]) {
+            write<std::uint64_t>(out, frames.size());
+            for (std::size_t i = 0; i < frames.size(); ++i) {
+                write<std::int64_t>(out, frames[i]);
+            }
+        }
+    }
+
+    /* Generated topologies, the others are regenerated on demand. */
+    std::uint64_t generated = 0;
+    for (auto &entry : this->topologies) {
+        generated += entry.second.generated;
+    }
+
+    write<std::uint64_t>(out, generated);
+    for (auto &entry : this->topologies) {
+        auto &topology = entry.second;
+        if (!topology.generated) {
             continue;
         }
 
-        interference.push_back(link_i.rssi);
+        write<double>(out, topology.timestamp);
+        write<std::uint64_t>(out, topology.links.size());
+        for (auto &link : topology.links) {
+            write<std::uint64_t>(out, link.id);
+            write<std::uint64_t>(out, link.nodes.first);
+            write<std::uint64_t>(out, link.nodes.second);
+            write<double>(out, link.rssi);
+            write<std::uint8_t>(out, link.silent);
+        }
+
+        for (auto offset : topology.offsets) {
+            write<std::uint64_t>(out, offset);
+        }
+
+        for (auto &neighbour : topology.adjacency) {
+            write<std::uint64_t>(out, neighbour.first);
+            write<std::uint64_t>(out, neighbour.second);
+        }
     }
 
-    auto pep = linklayer::pep(rssi, linklayer::PACKET_SIZE, interference);
-    return pep;
+    write_string(out, rng);
+
+    if (!out) {
+        throw std::runtime_error("failed to write model state");
+    }
 }
 
-linklayer::Topology &linklayer::LinkModel::get_topology(const double timestamp) {
-    auto lower_bound = 0.0;
-    for (auto &topology : this->topologies) {
-        if (common::is_equal(topology.first, timestamp)) {
-            lower_bound = topology.first;
-            break;
+std::string linklayer::LinkModel::restore_state(const linklayer::StateHeader &header, std::istream &in) {
+    const auto nchans = this->tx.size();
+    const auto n = this->node_index->ids.size();
+
+    if (header.fingerprint != this->trace->fingerprint || static_cast<std::size_t>(header.nchans) != nchans ||
+        read<std::uint64_t>(in) != n) {
+        throw std::runtime_error("model state does not match gpslog file");
+    }
+
+    /* Settings. */
+    this->events.enable(read<std::uint8_t>(in) != 0);
+    std::vector<linklayer::Event> events(read<std::uint64_t>(in));
+    for (auto &event : events) {
+        event.type = static_cast<linklayer::EventType>(read<std::uint8_t>(in));
+        event.id = read<std::int32_t>(in);
+        event.chn = read<std::int32_t>(in);
+        event.frame = read<std::int64_t>(in);
+        event.timestamp = read<double>(in);
+        event.duration = read<double>(in);
+        event.sequence = read<std::uint64_t>(in);
+
+        if (event.type > linklayer::BeginListen || event.chn < 0 || static_cast<std::size_t>(event.chn) >= nchans) {
+            throw std::runtime_error("malformed model state");
+        }
+    }
+    this->events.restore(std::move(events));
+    this->auto_advance = read<std::uint8_t>(in) != 0;
+    this->pep_cache.set_capacity(read<std::uint64_t>(in));
+    for (auto &row : this->coupling) {
+        row.resize(read<std::uint64_t>(in));
+        for (auto &coupled : row) {
+            coupled.first = read<std::int32_t>(in);
+            coupled.second = read<double>(in);
+            if (coupled.first < 0 || static_cast<std::size_t>(coupled.first) >= nchans) {
+                throw std::runtime_error("malformed model state");
+            }
+        }
+    }
+
+    /* Frames and listens. */
+    this->now = read<double>(in);
+    for (std::size_t chn = 0; chn < nchans; ++chn) {
+        this->watermark[chn] = read<double>(in);
+        this->tx[chn] = read_actions(in, n);
+        this->rx[chn] = read_actions(in, n);
+
+        this->tx_free[chn].resize(read<std::uint64_t>(in));
+        for (auto &slot : this->tx_free[chn]) {
+            slot = read<std::uint64_t>(in);
+            if (slot >= this->tx[chn].size()) {
+                throw std::runtime_error("malformed model state");
+            }
+        }
+
+        for (auto &frames : this->senders[chn]) {
+            frames = linklayer::RingBuffer<long long>{};
+            for (auto count = read<std::uint64_t>(in); count > 0; --count) {
+                frames.push_back(read<std::int64_t>(in));
+            }
+        }
+
+        auto &positions = this->listeners[chn];
+        std::fill(positions.begin(), positions.end(), -1);
+        this->listen_starts[chn].clear();
+        for (std::size_t i = 0; i < this->rx[chn].size(); ++i) {
+            auto &listen = this->rx[chn][i];
+            positions[listen.node] = static_cast<int>(i);
+            push_timed(this->listen_starts[chn], {listen.start, listen.node});
         }
 
-        if (timestamp <= topology.first && timestamp > lower_bound) {
-            break;
+        this->expiries[chn].clear();
+        for (auto &frame : this->tx[chn]) {
+            if (frame.state == linklayer::Transmit) {
+                push_timed(this->expiries[chn], {frame.end, frame.frame});
+            }
         }
 
-        lower_bound = topology.first;
+        this->active[chn] = static_cast<std::size_t>(
+                std::count_if(this->tx[chn].begin(), this->tx[chn].end(), [](const linklayer::Action &frame) {
+                    return frame.state == linklayer::Transmit;
+                }));
+        if (this->active[chn] > 0) {
+            this->active_bits[chn / 64] |= std::uint64_t{1} << (chn % 64);
+        } else {
+            this->active_bits[chn / 64] &= ~(std::uint64_t{1} << (chn % 64));
+        }
     }
 
+    /* Generated topologies. */
+    for (auto count = read<std::uint64_t>(in); count > 0; --count) {
+        auto timestamp = read<double>(in);
+        auto &topology = this->topologies[timestamp];
+        topology.timestamp = timestamp;
+
+        topology.links.resize(read<std::uint64_t>(in));
+        for (auto &link : topology.links) {
+            link.id = read<std::uint64_t>(in);
+            link.nodes.first = read<std::uint64_t>(in);
+            link.nodes.second = read<std::uint64_t>(in);
+            link.rssi = read<double>(in);
+            link.silent = read<std::uint8_t>(in) != 0;
+        }
+
+        topology.offsets.resize(n + 1);
+        for (auto &offset : topology.offsets) {
+            offset = read<std::uint64_t>(in);
+        }
+
+        if (topology.offsets[0] != 0 || !std::is_sorted(topology.offsets.begin(), topology.offsets.end()) ||
+            topology.offsets[n] != 2 * topology.links.size()) {
+            throw std::runtime_error("malformed model state");
+        }
+
+        topology.adjacency.resize(topology.offsets[n]);
+        for (auto &neighbour : topology.adjacency) {
+            neighbour.first = read<std::uint64_t>(in);
+            neighbour.second = read<std::uint64_t>(in);
+            if (neighbour.first >= n || neighbour.second >= topology.links.size()) {
+                throw std::runtime_error("malformed model state");
+            }
+        }
+
+        topology.generated = true;
+    }
+
+    return read_string(in);
+}
+
+linklayer::Topology &linklayer::LinkModel::get_topology(const double timestamp) {
+    /* Latest topology at or before timestamp. */
+    auto it = this->topologies.upper_bound(timestamp);
+    auto lower_bound = it == this->topologies.begin() ? 0.0 : std::prev(it)->first;
+
     auto &topology = this->topologies[lower_bound];
 
-    if (topology.links.empty()) {
+    if (topology.generated) {
+        LM_STATS_ADD(this, topology_hits, 1);
+    } else {
         /* Generate topology. */
+        LM_STATS_ADD(this, topology_misses, 1);
         const auto time = topology.timestamp;
+        const auto n = this->trace->nodes.size();
         auto &links = topology.links;
-
-        for (unsigned long i = 0; i < this->node_list.size(); ++i) {
-            auto node1 = this->node_list[i]; /* Copy */
-
-            for (auto &location : node1.location_history) {
-                if (location.get_time() <= time && location.get_time() > (time - linklayer::TIME_GAP)) {
-                    node1.location = location;
-                }
+        std::vector<std::pair<std::size_t, std::size_t>> ends{};  /* Node indices of each link. */
+
+        /* Most recent location of each node within the time gap. */
+        std::vector<const linklayer::Location *> locations(n, nullptr);
+        for (std::size_t i = 0; i < n; ++i) {
+            auto &history = this->trace->nodes[i].location_history;
+            auto next = std::upper_bound(history.begin(), history.end(), time,
+                                         [](double t, const linklayer::Location &l) { return t < l.get_time(); });
+            if (next == history.begin()) {
+                continue;
             }
 
-            for (unsigned long j = i + 1; j < this->node_list.size(); ++j) {
-                auto node2 = this->node_list[j]; /* Copy */
+            auto &location = *std::prev(next);
+            if (location.get_time() > (time - linklayer::TIME_GAP) &&
+                location.get_latitude() > 0 && location.get_longitude() > 0) {
+                locations[i] = &location;
+            }
+        }
 
-                for (auto &location : node2.location_history) {
-                    if (location.get_time() <= time && location.get_time() > (time - linklayer::TIME_GAP)) {
-                        node2.location = location;
-                    }
-                }
+        for (std::size_t i = 0; i < n; ++i) {
+            if (locations[i] == nullptr) {
+                continue;
+            }
 
-                if (!(node1.location.get_latitude() > 0 && node2.location.get_latitude() > 0) ||
-                    !(node1.location.get_longitude() > 0 && node2.location.get_longitude() > 0)) {
+            for (auto &connection : locations[i]->connections) {
+                auto j = connection.first;
+                if (j <= i || locations[j] == nullptr) {
                     continue;
                 }
 
-                auto it1 = node1.location.connections.find(node2.id);
-                auto it2 = node2.location.connections.find(node1.id);
-
-                if (it1 == node1.location.connections.end() || it2 == node2.location.connections.end()) {
+                /* Both nodes must report each other. */
+                auto &reverse = locations[j]->connections;
+                auto it2 = std::lower_bound(reverse.begin(), reverse.end(), i,
+                                            [](const std::pair<std::size_t, double> &c, std::size_t node) {
+                                                return c.first < node;
+                                            });
+                if (it2 == reverse.end() || it2->first != i) {
                     continue;
                 }
 
+                auto &node1 = this->trace->nodes[i];
+                auto &node2 = this->trace->nodes[j];
                 auto id = common::combine_ids(node1.id, node2.id);
-                links.emplace_back(id, node1, node2);
+                links.emplace_back(id, node1.id, node2.id);
+                ends.emplace_back(i, j);
                 auto &link = links.back();
-                link.rssi = (it1->second + it2->second) / 2;  /* Take the average of the two. */
+                link.rssi = (connection.second + it2->second) / 2;  /* Take the average of the two. */
+                link.silent = common::is_zero(link.rssi);
             }
         }
+
+        /* Links are generated in order of (i, j), so filling the adjacency lists in link order keeps them sorted. */
+        auto &offsets = topology.offsets;
+        auto &adjacency = topology.adjacency;
+        offsets.assign(n + 1, 0);
+        for (auto &end : ends) {
+            offsets[end.first + 1]++;
+            offsets[end.second + 1]++;
+        }
+        for (std::size_t i = 0; i < n; ++i) {
+            offsets[i + 1] += offsets[i];
+        }
+
+        adjacency.resize(offsets[n]);
+        std::vector<std::size_t> fill(offsets.begin(), offsets.end() - 1);
+        for (std::size_t k = 0; k < links.size(); ++k) {
+            auto x = ends[k].first;
+            auto y = ends[k].second;
+            adjacency[fill[x]++] = std::make_pair(y, k);
+            adjacency[fill[y]++] = std::make_pair(x, k);
+        }
+
+        topology.generated = true;
+        if (!links.empty()) {
+            LM_STATS_ADD(this, topologies_generated, 1);
+        }
     }
 
     return topology;
 }
 
-linklayer::LinkModel::LinkModel(int nchans, linklayer::NodeMap n_map) : tx(nchans), rx(nchans),
-                                                                        node_map(std::move(n_map)) {
-    /* Generate topologies. */
-    node_list.reserve(node_map.size());
-    for (auto &item : node_map) {
-        auto node = item.second;
-        node_list.push_back(node);
+linklayer::LinkModel::LinkModel(int nchans, std::shared_ptr<const linklayer::Trace> trace) : trace(std::move(trace)),
+                                                                                         tx(nchans), rx(nchans),
+                                                                                         tx_free(nchans),
+                                                                                         senders(nchans),
+                                                                                         listeners(nchans),
+                                                                                         expiries(nchans),
+                                                                                         listen_starts(nchans),
+                                                                                         watermark(nchans),
+                                                                                         coupling(nchans),
+                                                                                         active(nchans),
+                                                                                         active_bits((nchans + 63) / 64) {
+    auto &nodes = this->trace->nodes;
+    node_index = &this->trace->index;
+
+    for (int chn = 0; chn < nchans; ++chn) {
+        senders[chn].resize(nodes.size());
+        listeners[chn].assign(nodes.size(), -1);
     }
 
-    for (auto &item : node_map) {
-        auto &node = item.second;
+    /* Generate topologies. */
+    for (auto &node : nodes) {
         for (auto &location : node.location_history) {
             if (topologies.find(location.get_time()) == topologies.end()) {
                 topologies[location.get_time()] = {location.get_time()};
@@ -132,30 +512,3 @@ linklayer::LinkModel::LinkModel(int nchans, linklayer::NodeMap n_map) : tx(nchan
         }
     }
 }
-
-double linklayer::linearize(double logarithmic_value) {
-    return std::pow(10, logarithmic_value / 10);
-}
-
-double linklayer::logarithmicize(double linear_value) {
-    return 10 * std::log10(linear_value);
-}
-
-double linklayer::pep(double rssi, unsigned long packetsize, const std::vector<double> &interference) {
-    auto P_N_dB = linklayer::THERMAL_NOISE + linklayer::NOISE_FIGURE;
-    auto P_N = linearize(P_N_dB);
-
-    auto P_I = 0.0;
-    for (auto &RSSI_interference_dB : interference) {
-        P_I += linearize(RSSI_interference_dB);
-    }
-
-    auto P_NI = P_N + P_I;
-    auto P_NI_dB = logarithmicize(P_NI);
-    auto SINR_dB = rssi - P_NI_dB;
-    auto SINR = linearize(SINR_dB);
-
-    auto bep = 0.5 * std::erfc(std::sqrt(SINR / 2.0));  /* Bit error probability. */
-    auto pep = 1.0 - std::pow((1.0 - bep), packetsize * 8.0); /* Packet error probability. */
-    return pep;
-}
@@ -0,0 +1,26 @@
+#ifndef LINKLAYER_TRACE_H
+#define LINKLAYER_TRACE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <linklayer/model.h>
+
+#include "node.h"
+
+namespace linklayer {
+
+    using NodeList = std::vector<linklayer::Node>;  /* Sorted by identifier, positions are node indices. */
+
+    struct Trace {
+        std::string gpslog{};  /* Canonical path the trace was loaded from. */
+        std::uint64_t fingerprint{};  /* Hash of the parsed log, identifying it in saved states. */
+        NodeList nodes{};
+        NodeIndex index{};
+    };
+
+}
+
+
+#endif /* LINKLAYER_TRACE_H */
@@ -1,12 +1,39 @@
 #include <iostream>
 #include <string>
 #include <cstdio>
+#include <fstream>
 #include <unistd.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
 
 #include <catch2/catch.hpp>
 
 #include <linklayer/linkmodel.h>
-#include "../src/model.h"
+#include <linklayer/model.h>
+
+namespace linklayer {
+    struct ModelAccess {
+        template<typename Rng, typename Reception>
+        static LinkModel &state(Model<Rng, Reception> &model) {
+            return model;
+        }
+
+        template<typename Rng, typename Reception>
+        static Rng &rng(Model<Rng, Reception> &model) {
+            return model.rng;
+        }
+    };
+}
+
+/* Internal state of a model created through the C API. */
+linklayer::LinkModel *state_of(void *model) {
+    return &linklayer::ModelAccess::state(*static_cast<linklayer::DefaultModel *>(model));
+}
+
+std::mt19937 &rng_of(void *model) {
+    return linklayer::ModelAccess::rng(*static_cast<linklayer::DefaultModel *>(model));
+}
 
 void *get_test_model() {
     char logpath[] = "gpslog_rssi.txt";
@@ -16,12 +43,12 @@ void *get_test_model() {
 class TestModel {
 private:
     void *model;
-    linklayer::LinkModel *linkmodel;
+    linklayer::DefaultModel *linkmodel;
 
     TestModel() {
         std::cout << "Constructing test model... " << std::flush;
         this->model = get_test_model();
-        this->linkmodel = static_cast<linklayer::LinkModel *>(this->model);
+        this->linkmodel = static_cast<linklayer::DefaultModel *>(this->model);
         std::cout << "OK\n\n" << std::flush;
     }
 
@@ -39,7 +66,7 @@ public:
     }
 
     void *get_model() {
-        return static_cast<void *>(new linklayer::LinkModel{*this->linkmodel});
+        return static_cast<void *>(new linklayer::DefaultModel{*this->linkmodel});
     }
 };
 
@@ -149,4 +176,490 @@ TEST_CASE("alive_nodes()", "[linklayer/linkmodel]") {
     REQUIRE(node_count == 3);
 
     deinit(model);
-}
\ No newline at end of file
+}
+
+TEST_CASE("get_stats()/reset_stats()", "[linklayer/linkmodel]") {
+    auto *model = TestModel::get_instance()->get_model();
+    lm_stats stats{};
+
+    reset_stats(model);
+    REQUIRE(is_connected(model, 17, 42, 3960000));
+    REQUIRE(is_connected(model, 17, 49, 3960000));
+
+    if (get_stats(model, &stats)) {
+        REQUIRE(stats.is_connected.calls == 2);
+        REQUIRE(stats.topology_hits + stats.topology_misses == 2);
+        REQUIRE(stats.links_scanned > 0);
+
+        reset_stats(model);
+        REQUIRE(get_stats(model, &stats));
+        REQUIRE(stats.is_connected.calls == 0);
+        REQUIRE(stats.links_scanned == 0);
+    } else {
+        REQUIRE(stats.is_connected.calls == 0);
+    }
+
+    deinit(model);
+}
+
+TEST_CASE("finished actions are retired", "[linklayer/linkmodel]") {
+    auto *model = TestModel::get_instance()->get_model();
+    auto *lm = state_of(model);
+    set_auto_advance(model, true);
+
+    /* A long listen keeps transmissions overlapping it alive. */
+    begin_listen(model, 42, 1, 3960000, 1000);
+    for (int i = 0; i < 50; ++i) {
+        auto timestamp = 3960000.0 + i * 20;
+        begin_send(model, 17, 0, timestamp, 10);
+        begin_send(model, 64, 0, timestamp, 10);
+        begin_listen(model, 49, 0, timestamp, 10);
+        end_listen(model, 49, 0, timestamp + 10);
+    }
+    REQUIRE(lm->tx[0].size() == 2);
+    REQUIRE(lm->rx[0].empty());
+    REQUIRE(lm->rx[1].size() == 1);
+    REQUIRE(lm->expiries[0].size() <= 2);
+    REQUIRE(lm->listen_starts[0].size() <= 1);
+
+    /* Transmissions within the active listen are kept. */
+    begin_send(model, 17, 1, 3960100, 10);
+    begin_send(model, 64, 1, 3960200, 10);
+    REQUIRE(lm->tx[1].size() == 2);
+    REQUIRE(lm->watermark[1] <= 3960000);
+
+    REQUIRE(end_listen(model, 42, 1, 3961000) == 17);
+    advance(model, 3961001);
+    REQUIRE(std::none_of(lm->tx[1].begin(), lm->tx[1].end(), [](const linklayer::Action &a) {
+        return a.state == linklayer::Transmit;
+    }));
+    REQUIRE(lm->rx[1].empty());
+
+    deinit(model);
+}
+
+TEST_CASE("actions registered out of order", "[linklayer/linkmodel]") {
+    auto *model = TestModel::get_instance()->get_model();
+
+    /* A listen registered after a later transmission still sees earlier frames. */
+    begin_send(model, 17, 1, 3960000, 10);
+    begin_send(model, 42, 0, 3960020, 10);
+    begin_listen(model, 49, 1, 3960000, 40);
+    REQUIRE(end_listen(model, 49, 1, 3960040) == 17);
+
+    /* A listen is kept until it is ended, even past its duration. */
+    for (auto monotone : {false, true}) {
+        auto timestamp = monotone ? 3960200.0 : 3960100.0;
+        set_auto_advance(model, monotone);
+        begin_listen(model, 49, 1, timestamp, 20);
+        begin_send(model, 17, 1, timestamp, 15);
+        begin_send(model, 42, 0, timestamp + 25, 10);
+        REQUIRE(end_listen(model, 49, 1, timestamp + 30) == 17);
+        advance(model, timestamp + 100);
+    }
+
+    deinit(model);
+}
+
+TEST_CASE("frames are reclaimed without advancing the clock", "[linklayer/linkmodel]") {
+    auto *model = TestModel::get_instance()->get_model();
+    auto *lm = state_of(model);
+
+    /* Default settings: each send reuses the node's ended frames. */
+    for (int i = 0; i < 10000; ++i) {
+        auto timestamp = 3960000.0 + i * 20;
+        begin_send(model, 17, 1, timestamp, 10);
+        begin_send(model, 17, 0, timestamp, 10);
+        end_send(model, 17, 0, timestamp + 5);
+        if (i % 100 == 0) {
+            begin_listen(model, 49, 1, timestamp, 20);
+            REQUIRE(end_listen(model, 49, 1, timestamp + 20) == 17);
+        }
+    }
+
+    REQUIRE(lm->tx[0].size() <= 2);
+    REQUIRE(lm->tx[1].size() <= 2);
+    REQUIRE(lm->expiries[0].size() <= 32);
+    REQUIRE(lm->expiries[1].size() <= 32);
+    REQUIRE(lm->listen_starts[1].size() <= 32);
+    REQUIRE(lm->senders[1][lm->index_of(17)].size() <= 2);
+
+    /* A listen that is never ended keeps frames, but only up to a bound per node. */
+    begin_listen(model, 49, 1, 4160000, 20);
+    for (int i = 0; i < 1000; ++i) {
+        begin_send(model, 17, 1, 4160000.0 + i * 20, 10);
+    }
+    REQUIRE(lm->tx[1].size() <= linklayer::MAX_NODE_FRAMES);
+    REQUIRE(lm->expiries[1].size() <= 2 * linklayer::MAX_NODE_FRAMES + 16);
+
+    deinit(model);
+}
+
+TEST_CASE("overlapping frames from one node", "[linklayer/linkmodel]") {
+    auto *model = TestModel::get_instance()->get_model();
+
+    REQUIRE(is_connected(model, 17, 49, 3960000));
+    REQUIRE(is_connected(model, 42, 49, 3960000));
+    auto first = begin_send(model, 42, 1, 3960000, 30);
+    auto second = begin_send(model, 42, 1, 3960005, 10);
+    REQUIRE(first > 0);
+    REQUIRE(second > 0);
+    REQUIRE(first != second);
+
+    /* The strong frame from 17 is not disturbed by either frame from 42. */
+    begin_send(model, 17, 1, 3960005, 10);
+    begin_listen(model, 49, 1, 3960000, 40);
+    REQUIRE(end_listen(model, 49, 1, 3960020) == 17);
+
+    /* Ending the second frame leaves the first on air. */
+    end_frame(model, second, 3960010);
+    auto *lm = state_of(model);
+    REQUIRE(lm->find_frame(first)->end == Approx(3960030));
+    REQUIRE(lm->find_frame(second)->end == Approx(3960010));
+
+    /* end_send() targets the most recent frame. */
+    end_send(model, 42, 1, 3960012);
+    REQUIRE(lm->find_frame(second)->end == Approx(3960012));
+    REQUIRE(lm->find_frame(first)->end == Approx(3960030));
+
+    /* Stale handles are ignored once the frame is retired. */
+    advance(model, 3960100);
+    REQUIRE(lm->find_frame(first) == nullptr);
+    auto third = begin_send(model, 42, 1, 3960100, 10);
+    REQUIRE(third != first);
+    REQUIRE(third != second);
+    end_frame(model, first, 3960101);
+    REQUIRE(lm->find_frame(third)->end == Approx(3960110));
+
+    /* Handles of a reused slot do not repeat and are never 0. */
+    set_auto_advance(model, true);
+    for (int i = 1; i <= 200; ++i) {
+        auto timestamp = 3960100.0 + i * 20;
+        auto frame = begin_send(model, 42, 1, timestamp, 10);
+        REQUIRE(frame > 0);
+        REQUIRE(frame != first);
+        end_frame(model, first, timestamp + 1);
+        REQUIRE(lm->find_frame(frame)->end == Approx(timestamp + 10));
+    }
+
+    deinit(model);
+}
+
+TEST_CASE("queued ingestion from several threads", "[linklayer/linkmodel]") {
+    auto *model = TestModel::get_instance()->get_model();
+    auto *lm = state_of(model);
+
+    set_queued(model, true);
+    set_auto_advance(model, true);
+
+    /* Producers push out of timestamp order; the model applies them in order. */
+    std::vector<std::thread> producers{};
+    const int senders[] = {17, 42, 64, 32};
+    for (auto id : senders) {
+        producers.emplace_back([model, id]() {
+            for (int i = 99; i >= 0; --i) {
+                begin_send(model, id, 0, 3950000.0 + i * 100, 10);
+            }
+        });
+    }
+    for (auto &producer : producers) {
+        producer.join();
+    }
+
+    REQUIRE(std::none_of(lm->tx[0].begin(), lm->tx[0].end(), [](const linklayer::Action &a) {
+        return a.state == linklayer::Transmit;
+    }));
+    REQUIRE(is_connected(model, 17, 49, 3960000));
+    REQUIRE(std::count_if(lm->tx[0].begin(), lm->tx[0].end(), [](const linklayer::Action &a) {
+        return a.state == linklayer::Transmit;
+    }) == 4);
+    REQUIRE(lm->now == Approx(3959900));
+
+    begin_send(model, 17, 1, 3960005, 10);
+    begin_listen(model, 49, 1, 3960000, 40);
+    REQUIRE(end_listen(model, 49, 1, 3960020) == 17);
+
+    set_queued(model, false);
+    REQUIRE(begin_send(model, 17, 1, 3960030, 10) > 0);
+
+    deinit(model);
+}
+
+TEST_CASE("queued events after a query stay pending", "[linklayer/linkmodel]") {
+    auto *model = TestModel::get_instance()->get_model();
+    auto *lm = state_of(model);
+
+    lm_stats stats{};
+    reset_stats(model);
+    set_queued(model, true);
+    set_auto_advance(model, true);
+
+    /* A producer running ahead must not retire the listen before it is queried. */
+    begin_listen(model, 49, 1, 3960000, 40);
+    begin_send(model, 17, 1, 3960005, 10);
+    begin_send(model, 42, 0, 3960100, 10);
+    REQUIRE(end_listen(model, 49, 1, 3960020) == 17);
+    REQUIRE_FALSE(lm->events.empty());
+    REQUIRE(lm->tx[0].empty());
+    if (get_stats(model, &stats)) {
+        /* Queued calls are counted once applied. */
+        REQUIRE(stats.begin_listen.calls == 1);
+        REQUIRE(stats.begin_send.calls == 1);
+    }
+
+    advance(model, 3960100);
+    REQUIRE(lm->events.empty());
+    REQUIRE(lm->tx[0].size() == 1);
+    if (get_stats(model, &stats)) {
+        REQUIRE(stats.begin_send.calls == 2);
+    }
+
+    deinit(model);
+}
+
+TEST_CASE("node identifiers map to dense indices", "[linklayer/linkmodel]") {
+    auto *model = TestModel::get_instance()->get_model();
+    auto *lm = state_of(model);
+
+    auto &ids = lm->node_index->ids;
+    for (std::size_t i = 0; i < ids.size(); ++i) {
+        REQUIRE(lm->index_of(static_cast<int>(ids[i])) == static_cast<int>(i));
+    }
+    REQUIRE(lm->index_of(-1) == -1);
+    REQUIRE(lm->index_of(1) == -1);
+
+    /* Unknown nodes are neither connected nor able to send or listen. */
+    REQUIRE_FALSE(is_connected(model, 17, 1, 3960000));
+    REQUIRE(begin_send(model, 1, 0, 3960000, 10) == -1);
+    begin_listen(model, 1, 0, 3960000, 10);
+    REQUIRE(end_listen(model, 1, 0, 3960010) == -1);
+
+    deinit(model);
+}
+
+struct Lossless {
+    static double error(double, const std::vector<double> &) {
+        return 0.0;
+    }
+};
+
+TEST_CASE("adjacent channel interference", "[linklayer/linkmodel]") {
+    auto *model = TestModel::get_instance()->get_model();
+    auto *lm = state_of(model);
+
+    /* Channels are isolated by default. */
+    begin_send(model, 42, 1, 3960000, 20);
+    begin_send(model, 17, 0, 3960000, 20);
+    begin_listen(model, 49, 1, 3960000, 30);
+    REQUIRE(end_listen(model, 49, 1, 3960030) == 42);
+
+    /* Strong leakage from 17 on the coupled channel corrupts the frame from 42. */
+    set_channel_coupling(model, 0, 1, 3.0);
+    REQUIRE(lm->coupling[0].size() == 1);
+    REQUIRE(lm->coupling[1].size() == 1);
+    begin_send(model, 42, 1, 3960100, 20);
+    begin_send(model, 17, 0, 3960100, 20);
+    begin_listen(model, 49, 1, 3960100, 30);
+    REQUIRE(end_listen(model, 49, 1, 3960130) == -1);
+
+    /* Channels without transmitters are skipped. */
+    lm_stats stats{};
+    advance(model, 3960200);
+    REQUIRE_FALSE(lm->is_active(0));
+    reset_stats(model);
+    begin_send(model, 42, 1, 3960200, 20);
+    begin_listen(model, 49, 1, 3960200, 30);
+    REQUIRE(end_listen(model, 49, 1, 3960230) == 42);
+    if (get_stats(model, &stats)) {
+        REQUIRE(stats.coupled_channels_scanned == 0);
+    }
+
+    /* Sufficient attenuation makes the leakage negligible. */
+    set_channel_coupling(model, 1, 0, 80.0);
+    begin_send(model, 42, 1, 3960300, 20);
+    begin_send(model, 17, 0, 3960300, 20);
+    begin_listen(model, 49, 1, 3960300, 30);
+    REQUIRE(end_listen(model, 49, 1, 3960330) == 42);
+    if (get_stats(model, &stats)) {
+        REQUIRE(stats.coupled_channels_scanned == 1);
+    }
+
+    /* Negligible couplings are not kept. */
+    set_channel_coupling(model, 0, 1, 150.0);
+    REQUIRE(lm->coupling[0].empty());
+    REQUIRE(lm->coupling[1].empty());
+
+    set_channel_coupling(model, 0, 1, 20.0);
+    set_channel_coupling(model, 0, 1, INFINITY);
+    REQUIRE(lm->coupling[0].empty());
+    REQUIRE(lm->coupling[1].empty());
+
+    deinit(model);
+}
+
+TEST_CASE("save_state()/load_state()", "[linklayer/linkmodel]") {
+    auto *model = TestModel::get_instance()->get_model();
+    auto *lm = state_of(model);
+
+    set_pep_cache(model, 8);
+    set_channel_coupling(model, 0, 1, 20.0);
+    REQUIRE(is_connected(model, 17, 49, 3960000));
+    begin_send(model, 17, 1, 3960000, 15);
+    begin_send(model, 42, 1, 3960005, 20);
+    begin_send(model, 64, 0, 3960005, 20);
+    begin_listen(model, 49, 1, 3960000, 40);
+    REQUIRE(save_state(model, "state.bin"));
+
+    /* Forks share the trace and continue exactly like the original. */
+    auto *fork = load_state("state.bin");
+    REQUIRE(fork != nullptr);
+    auto *lf = state_of(fork);
+    REQUIRE(lf->trace == lm->trace);
+    REQUIRE(lf->node_index == lm->node_index);
+    REQUIRE(rng_of(fork) == rng_of(model));
+    REQUIRE(lf->tx == lm->tx);
+    REQUIRE(lf->rx == lm->rx);
+    REQUIRE(lf->listeners == lm->listeners);
+    REQUIRE(lf->coupling == lm->coupling);
+    REQUIRE(lf->pep_cache.capacity() == 8);
+    REQUIRE(lf->is_active(0));
+    REQUIRE(lf->get_topology(3960000).generated);
+    REQUIRE(lf->get_topology(3960000).links.size() == lm->get_topology(3960000).links.size());
+
+    REQUIRE(end_listen(model, 49, 1, 3960040) == 17);
+    REQUIRE(end_listen(fork, 49, 1, 3960040) == 17);
+    for (int i = 0; i < 10; ++i) {
+        auto timestamp = 3960100.0 + i * 100;
+        begin_send(model, 42, 1, timestamp, 20);
+        begin_send(fork, 42, 1, timestamp, 20);
+        begin_listen(model, 49, 1, timestamp, 30);
+        begin_listen(fork, 49, 1, timestamp, 30);
+        REQUIRE(end_listen(model, 49, 1, timestamp + 30) == end_listen(fork, 49, 1, timestamp + 30));
+    }
+
+    REQUIRE(load_state("gpslog.txt") == nullptr);
+
+    deinit(fork);
+    deinit(model);
+    std::remove("state.bin");
+}
+
+TEST_CASE("saved states check the gpslog they refer to", "[linklayer/linkmodel]") {
+    {
+        std::ifstream original{"gpslog_rssi.txt"};
+        std::ofstream copy{"gpslog_copy.txt"};
+        copy << original.rdbuf();
+    }
+
+    char cwd[4096];
+    REQUIRE(getcwd(cwd, sizeof(cwd)) != nullptr);
+    auto state = std::string{cwd} + "/state_copy.bin";
+
+    auto *model = initialize(2, "gpslog_copy.txt");
+    REQUIRE(model != nullptr);
+    begin_send(model, 17, 1, 3960000, 15);
+    REQUIRE(save_state(model, state.c_str()));
+    deinit(model);
+
+    /* The gpslog is found from another working directory. */
+    REQUIRE(chdir("/") == 0);
+    auto *restored = load_state(state.c_str());
+    REQUIRE(chdir(cwd) == 0);
+    REQUIRE(restored != nullptr);
+    REQUIRE(state_of(restored)->tx[1].size() == 1);
+    deinit(restored);
+
+    /* An edited gpslog is rejected. */
+    {
+        std::ofstream copy{"gpslog_copy.txt", std::ios::app};
+        copy << "17,55.850163,12.459169,4000000.000000,32,-12\n";
+    }
+    REQUIRE(load_state(state.c_str()) == nullptr);
+
+    std::remove(state.c_str());
+    std::remove("gpslog_copy.txt");
+}
+
+TEST_CASE("C++ model with policies", "[linklayer/model]") {
+    auto trace = linklayer::load_trace("gpslog_rssi.txt");
+    linklayer::Model<std::minstd_rand, Lossless> model{2, trace, std::minstd_rand{42}};
+
+    REQUIRE(model.is_connected(17, 42, 3960000));
+    REQUIRE_FALSE(model.is_connected(17, 64, 3960000));
+    REQUIRE(model.get_link(17, 42, 3960000).rssi < 0.0);
+
+    /* Interference is ignored by the lossless reception model. */
+    model.begin_send(17, 1, 3960000, 15);
+    model.begin_send(42, 1, 3960005, 20);
+    model.begin_listen(49, 1, 3960000, 40);
+    REQUIRE(model.end_listen(49, 1, 3960030) == 17);
+
+    /* Models share the immutable trace. */
+    linklayer::DefaultModel other{1, trace};
+    REQUIRE(linklayer::ModelAccess::state(other).trace == linklayer::ModelAccess::state(model).trace);
+    REQUIRE(other.alive_nodes(3960000).size() == 24);
+
+    REQUIRE_THROWS_AS(linklayer::load_trace("does_not_exist.txt"), std::runtime_error);
+}
+
+TEST_CASE("PEP cache", "[linklayer/model]") {
+    auto *model = TestModel::get_instance()->get_model();
+    auto *lm = state_of(model);
+
+    REQUIRE(pep_cache_hit_rate(model) == Approx(0.0));
+    set_pep_cache(model, 16);
+
+    /* Periodic broadcasts within one epoch repeat the same combinations. */
+    for (int i = 0; i < 10; ++i) {
+        auto timestamp = 3960000.0 + i * 100;
+        begin_send(model, 17, 1, timestamp, 15);
+        begin_send(model, 42, 1, timestamp + 5, 20);
+        begin_listen(model, 49, 1, timestamp, 40);
+        REQUIRE(end_listen(model, 49, 1, timestamp + 40) == 17);
+    }
+
+    REQUIRE(lm->pep_cache.misses == 2);
+    REQUIRE(lm->pep_cache.hits == 18);
+    REQUIRE(pep_cache_hit_rate(model) == Approx(0.9));
+
+    /* Cached probabilities equal computed ones. */
+    linklayer::Action t{linklayer::Transmit, 42, 1, 3960005, 3960025};
+    linklayer::Action r{linklayer::Listen, 49, 1, 3960000, 3960040};
+    t.node = lm->index_of(42);
+    r.node = lm->index_of(49);
+    t.frame = 1;
+    std::vector<linklayer::Action> tx_list{t, {linklayer::Transmit, 17, 1, 3960000, 3960015}};
+    tx_list.back().node = lm->index_of(17);
+    tx_list.back().frame = 2;
+    auto *m = static_cast<linklayer::DefaultModel *>(model);
+    auto cached = m->should_receive(t, r, tx_list);
+    set_pep_cache(model, 0);
+    REQUIRE(m->should_receive(t, r, tx_list) == Approx(cached));
+
+    deinit(model);
+}
+
+TEST_CASE("PEP cache evicts least recently used", "[linklayer/model]") {
+    linklayer::PepCache cache{};
+    cache.insert({1.0, 0, 1}, 1, 0.5);
+    REQUIRE(cache.size() == 0);
+
+    cache.set_capacity(2);
+    linklayer::PepKey a{1.0, 0, 1}, b{1.0, 0, 2}, c{1.0, 0, 3};
+    cache.insert(a, a.hash(), 0.1);
+    cache.insert(b, b.hash(), 0.2);
+    REQUIRE(*cache.find(a, a.hash()) == Approx(0.1));
+    cache.insert(c, c.hash(), 0.3);
+
+    REQUIRE(cache.size() == 2);
+    REQUIRE(cache.find(b, b.hash()) == nullptr);
+    REQUIRE(*cache.find(a, a.hash()) == Approx(0.1));
+    REQUIRE(*cache.find(c, c.hash()) == Approx(0.3));
+
+    /* Interferer sets are compared, not just hashed. */
+    linklayer::PepKey d{1.0, 0, 1, {{2, 1.0, 0.0}}};
+    REQUIRE(cache.find(d, a.hash()) == nullptr);
+
+    linklayer::PepCache copy{cache};
+    REQUIRE(*copy.find(c, c.hash()) == Approx(0.3));
+}
@@ -0,0 +1,455 @@
+/*
+ * Synthetic GPS/RSSI trace generator.
+ *
+ * Writes logs in the format read by parse_gpsfile():
+ *
+ *     id,latitude,longitude,timestamp[,neighbour_id,rssi]...
+ *
+ * with one line per node per epoch, so that topology generation and memory use
+ * can be measured at deployment scale. Output is fully determined by the seed.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+    const double EARTH_METERS_PER_DEGREE = 111320.0;
+    const double PI = 3.14159265358979323846;
+
+    enum class Mobility {
+        RandomWaypoint,
+        Grid,
+        Cluster,
+    };
+
+    struct Options {
+        unsigned long nodes{100};
+        double duration{3600.0};      /* Seconds. */
+        double interval{20.0};        /* Seconds between epochs. */
+        Mobility mobility{Mobility::RandomWaypoint};
+        unsigned long long seed{1};
+        double area{5000.0};          /* Side of the square area in meters. */
+        double latitude{55.85};       /* South-west corner of the area. */
+        double longitude{12.45};
+        double min_speed{0.5};        /* Meters per second. */
+        double max_speed{2.0};
+        double max_pause{300.0};      /* Seconds. */
+        double block{200.0};          /* Grid block size in meters. */
+        unsigned long clusters{10};
+        double cluster_radius{150.0};
+        double ref_rssi{-40.0};       /* dBm at 1 meter. */
+        double exponent{2.7};         /* Path loss exponent. */
+        double shadowing{4.0};        /* Log-normal shadowing standard deviation in dB. */
+        double threshold{-110.0};     /* Weakest RSSI reported. */
+        bool rssi{true};
+        const char *output{nullptr};
+    };
+
+    struct Position {
+        double x{};
+        double y{};
+    };
+
+    struct MobileNode {
+        Position position{};
+        Position target{};
+        double speed{};
+        double pause{};
+    };
+
+    void usage(const char *program) {
+        std::cerr << "usage: " << program << " [options] <output>\n"
+                  << "  --nodes N             number of nodes (default 100)\n"
+                  << "  --duration T          trace length, suffix s/m/h/d/w (default 1h)\n"
+                  << "  --interval T          time between GPS fixes, suffix s/m/h/d/w (default 20s)\n"
+                  << "  --mobility MODEL      waypoint, grid or cluster (default waypoint)\n"
+                  << "  --seed S              random seed (default 1)\n"
+                  << "  --area M              side of the square area in meters (default 5000)\n"
+                  << "  --origin LAT,LON      south-west corner of the area (default 55.85,12.45)\n"
+                  << "  --speed MIN,MAX       node speed in m/s (default 0.5,2)\n"
+                  << "  --pause T             maximum waypoint pause, suffix s/m/h/d/w (default 5m)\n"
+                  << "  --block M             grid block size in meters (default 200)\n"
+                  << "  --clusters N          number of static clusters (default 10)\n"
+                  << "  --cluster-radius M    radius of a static cluster in meters (default 150)\n"
+                  << "  --ref-rssi DBM        RSSI at 1 meter (default -40)\n"
+                  << "  --exponent N          path loss exponent (default 2.7)\n"
+                  << "  --shadowing DB        shadowing standard deviation (default 4)\n"
+                  << "  --threshold DBM       weakest RSSI reported (default -110)\n"
+                  << "  --no-rssi             only write GPS coordinates\n";
+    }
+
+    double parse_time(const std::string &value) {
+        std::size_t pos{};
+        auto time = std::stod(value, &pos);
+        auto unit = value.substr(pos);
+
+        if (unit.empty() || unit == "s") {
+            return time;
+        } else if (unit == "m") {
+            return time * 60.0;
+        } else if (unit == "h") {
+            return time * 3600.0;
+        } else if (unit == "d") {
+            return time * 86400.0;
+        } else if (unit == "w") {
+            return time * 604800.0;
+        }
+
+        throw std::invalid_argument("invalid time unit '" + unit + "'");
+    }
+
+    std::pair<double, double> parse_pair(const std::string &value) {
+        auto comma = value.find(',');
+        if (comma == std::string::npos) {
+            throw std::invalid_argument("expected two comma-separated values");
+        }
+
+        return std::make_pair(std::stod(value.substr(0, comma)), std::stod(value.substr(comma + 1)));
+    }
+
+    Options parse_options(int argc, char *argv[]) {
+        Options options{};
+
+        for (int i = 1; i < argc; ++i) {
+            std::string arg{argv[i]};
+
+            if (arg == "--no-rssi") {
+                options.rssi = false;
+                continue;
+            }
+
+            if (arg.compare(0, 2, "--") != 0) {
+                if (options.output) {
+                    throw std::invalid_argument("more than one output file given");
+                }
+                options.output = argv[i];
+                continue;
+            }
+
+            if (i + 1 >= argc) {
+                throw std::invalid_argument("missing value for " + arg);
+            }
+            std::string value{argv[++i]};
+
+            if (arg == "--nodes") {
+                options.nodes = std::stoul(value);
+            } else if (arg == "--duration") {
+                options.duration = parse_time(value);
+            } else if (arg == "--interval") {
+                options.interval = parse_time(value);
+            } else if (arg == "--mobility") {
+                if (value == "waypoint") {
+                    options.mobility = Mobility::RandomWaypoint;
+                } else if (value == "grid") {
+                    options.mobility = Mobility::Grid;
+                } else if (value == "cluster") {
+                    options.mobility = Mobility::Cluster;
+                } else {
+                    throw std::invalid_argument("unknown mobility model '" + value + "'");
+                }
+            } else if (arg == "--seed") {
+                options.seed = std::stoull(value);
+            } else if (arg == "--area") {
+                options.area = std::stod(value);
+            } else if (arg == "--origin") {
+                std::tie(options.latitude, options.longitude) = parse_pair(value);
+            } else if (arg == "--speed") {
+                std::tie(options.min_speed, options.max_speed) = parse_pair(value);
+            } else if (arg == "--pause") {
+                options.max_pause = parse_time(value);
+            } else if (arg == "--block") {
+                options.block = std::stod(value);
+            } else if (arg == "--clusters") {
+                options.clusters = std::stoul(value);
+            } else if (arg == "--cluster-radius") {
+                options.cluster_radius = std::stod(value);
+            } else if (arg == "--ref-rssi") {
+                options.ref_rssi = std::stod(value);
+            } else if (arg == "--exponent") {
+                options.exponent = std::stod(value);
+            } else if (arg == "--shadowing") {
+                options.shadowing = std::stod(value);
+            } else if (arg == "--threshold") {
+                options.threshold = std::stod(value);
+            } else {
+                throw std::invalid_argument("unknown option " + arg);
+            }
+        }
+
+        if (!options.output) {
+            throw std::invalid_argument("no output file given");
+        }
+
+        if (options.nodes == 0 || options.interval <= 0.0 || options.duration < 0.0 || options.area <= 0.0 ||
+            options.block <= 0.0 || options.clusters == 0 || options.min_speed <= 0.0 ||
+            options.max_speed < options.min_speed || options.latitude <= 0.0 || options.longitude <= 0.0) {
+            /* The link model ignores non-positive coordinates. */
+            throw std::invalid_argument("option value out of range");
+        }
+
+        return options;
+    }
+
+    class Generator {
+    public:
+        explicit Generator(const Options &options) : options(options), gen(options.seed), nodes(options.nodes) {
+            std::uniform_real_distribution<double> coord{0.0, options.area};
+
+            if (options.mobility == Mobility::Cluster) {
+                std::vector<Position> centers(options.clusters);
+                for (auto &center : centers) {
+                    center = {coord(gen), coord(gen)};
+                }
+
+                std::uniform_int_distribution<unsigned long> pick{0, options.clusters - 1};
+                std::uniform_real_distribution<double> angle{0.0, 2 * PI};
+                std::uniform_real_distribution<double> unit{0.0, 1.0};
+                for (auto &node : nodes) {
+                    auto &center = centers[pick(gen)];
+                    auto r = options.cluster_radius * std::sqrt(unit(gen));
+                    auto a = angle(gen);
+                    node.position = {clamp(center.x + r * std::cos(a)), clamp(center.y + r * std::sin(a))};
+                }
+            } else if (options.mobility == Mobility::Grid) {
+                for (auto &node : nodes) {
+                    node.position = snap({coord(gen), coord(gen)});
+                    next_grid_target(node);
+                }
+            } else {
+                for (auto &node : nodes) {
+                    node.position = {coord(gen), coord(gen)};
+                    next_waypoint(node);
+                }
+            }
+
+            /* Search radius for neighbours, leaving room for shadowing above the mean. */
+            auto margin = 3.0 * options.shadowing;
+            range = std::pow(10.0, (options.ref_rssi - options.threshold + margin) / (10.0 * options.exponent));
+        }
+
+        void run(std::FILE *out) {
+            auto epochs = static_cast<unsigned long>(options.duration / options.interval);
+            std::vector<std::vector<std::pair<unsigned long, double>>> neighbours(nodes.size());
+
+            for (unsigned long epoch = 0; epoch <= epochs; ++epoch) {
+                if (epoch > 0) {
+                    move(options.interval);
+                }
+
+                if (options.rssi) {
+                    connect(neighbours);
+                }
+
+                auto timestamp = epoch * options.interval * 1000.0; /* The model uses milliseconds. */
+                for (unsigned long i = 0; i < nodes.size(); ++i) {
+                    auto &position = nodes[i].position;
+                    auto latitude = options.latitude + position.y / EARTH_METERS_PER_DEGREE;
+                    auto longitude = options.longitude + position.x / (EARTH_METERS_PER_DEGREE * lon_scale());
+
+                    std::fprintf(out, "%lu,%.6f,%.6f,%.6f", i + 1, latitude, longitude, timestamp);
+                    for (auto &neighbour : neighbours[i]) {
+                        std::fprintf(out, ",%lu,%.2f", neighbour.first + 1, neighbour.second);
+                    }
+                    std::fputc('\n', out);
+                }
+            }
+        }
+
+    private:
+        const Options &options;
+        std::mt19937_64 gen;
+        std::vector<MobileNode> nodes;
+        double range{};
+
+        double lon_scale() const {
+            return std::cos(options.latitude * PI / 180.0);
+        }
+
+        double clamp(double v) const {
+            return std::min(std::max(v, 0.0), options.area);
+        }
+
+        Position snap(Position p) const {
+            /* Place the node on the nearest street of the grid. */
+            auto gx = std::round(p.x / options.block) * options.block;
+            auto gy = std::round(p.y / options.block) * options.block;
+            if (std::fabs(gx - p.x) < std::fabs(gy - p.y)) {
+                return {clamp(gx), p.y};
+            }
+            return {p.x, clamp(gy)};
+        }
+
+        double speed() {
+            std::uniform_real_distribution<double> d{options.min_speed, options.max_speed};
+            return d(gen);
+        }
+
+        double pause() {
+            std::uniform_real_distribution<double> d{0.0, options.max_pause};
+            return d(gen);
+        }
+
+        void next_waypoint(MobileNode &node) {
+            std::uniform_real_distribution<double> coord{0.0, options.area};
+            node.target = {coord(gen), coord(gen)};
+            node.speed = speed();
+        }
+
+        void next_grid_target(MobileNode &node) {
+            /* Walk to the next intersection along the current street. */
+            auto on_vertical = std::fmod(node.position.x, options.block) == 0.0;
+            auto on_horizontal = std::fmod(node.position.y, options.block) == 0.0;
+            std::bernoulli_distribution vertical{0.5};
+            std::bernoulli_distribution forward{0.5};
+
+            auto go_vertical = on_vertical && (!on_horizontal || vertical(gen));
+            auto step = forward(gen) ? options.block : -options.block;
+            auto &axis = go_vertical ? node.position.y : node.position.x;
+            auto next = std::floor(axis / options.block) * options.block;
+            if (step > 0.0 || next == axis) {
+                next += step;
+            }
+            if (next < 0.0 || next > options.area) {
+                next -= 2 * step;
+            }
+
+            node.target = node.position;
+            (go_vertical ? node.target.y : node.target.x) = clamp(next);
+            node.speed = speed();
+        }
+
+        void move(double dt) {
+            if (options.mobility == Mobility::Cluster) {
+                return;
+            }
+
+            for (auto &node : nodes) {
+                auto left = dt;
+
+                while (left > 0.0) {
+                    if (node.pause > 0.0) {
+                        auto wait = std::min(node.pause, left);
+                        node.pause -= wait;
+                        left -= wait;
+                        continue;
+                    }
+
+                    auto dx = node.target.x - node.position.x;
+                    auto dy = node.target.y - node.position.y;
+                    auto distance = std::sqrt(dx * dx + dy * dy);
+                    auto travel = node.speed * left;
+
+                    if (travel < distance) {
+                        node.position.x += dx / distance * travel;
+                        node.position.y += dy / distance * travel;
+                        break;
+                    }
+
+                    node.position = node.target;
+                    left -= distance / node.speed;
+
+                    if (options.mobility == Mobility::Grid) {
+                        next_grid_target(node);
+                    } else {
+                        node.pause = pause();
+                        next_waypoint(node);
+                    }
+                }
+            }
+        }
+
+        void connect(std::vector<std::vector<std::pair<unsigned long, double>>> &neighbours) {
+            /* Bucket nodes in cells of the search radius, so only adjacent cells are compared. */
+            auto cells = static_cast<long>(std::ceil(options.area / range)) + 1;
+            std::unordered_map<long, std::vector<unsigned long>> grid{};
+            for (unsigned long i = 0; i < nodes.size(); ++i) {
+                auto cx = static_cast<long>(nodes[i].position.x / range);
+                auto cy = static_cast<long>(nodes[i].position.y / range);
+                grid[cx * cells + cy].push_back(i);
+            }
+
+            for (auto &list : neighbours) {
+                list.clear();
+            }
+
+            std::normal_distribution<double> shadow{0.0, options.shadowing};
+            for (unsigned long i = 0; i < nodes.size(); ++i) {
+                auto &p1 = nodes[i].position;
+                auto cx = static_cast<long>(p1.x / range);
+                auto cy = static_cast<long>(p1.y / range);
+
+                for (long x = cx - 1; x <= cx + 1; ++x) {
+                    for (long y = cy - 1; y <= cy + 1; ++y) {
+                        auto cell = grid.find(x * cells + y);
+                        if (x < 0 || y < 0 || cell == grid.end()) {
+                            continue;
+                        }
+
+                        for (auto j : cell->second) {
+                            if (j <= i) {
+                                continue; /* Each pair is drawn once and reported by both nodes. */
+                            }
+
+                            auto &p2 = nodes[j].position;
+                            auto distance = std::max(1.0, std::hypot(p1.x - p2.x, p1.y - p2.y));
+                            if (distance > range) {
+                                continue;
+                            }
+
+                            auto rssi = options.ref_rssi - 10.0 * options.exponent * std::log10(distance);
+                            if (options.shadowing > 0.0) {
+                                rssi += shadow(gen);
+                            }
+                            if (rssi < options.threshold) {
+                                continue;
+                            }
+
+                            neighbours[i].emplace_back(j, rssi);
+                            neighbours[j].emplace_back(i, rssi);
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+}
+
+int main(int argc, char *argv[]) {
+    Options options{};
+    try {
+        options = parse_options(argc, argv);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    auto *out = std::fopen(options.output, "w");
+    if (!out) {
+        std::cerr << "failed to open " << options.output << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    Generator generator{options};
+    generator.run(out);
+
+    if (std::fclose(out) != 0) {
+        std::cerr << "failed to write " << options.output << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}